@@ -0,0 +1,53 @@
+#shader vertex
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 velocity;
+
+uniform mat4 u_MVP;
+uniform float u_PointScale;
+
+out vec4 v_Colour;
+
+float max_visual_speed = 4.0f;
+
+void main()
+{
+	gl_Position = u_MVP * vec4(position, 1.0);
+	// Perspective size, so nearer particles draw larger
+	gl_PointSize = u_PointScale / gl_Position.w;
+
+	float speed = length(velocity);
+	float t = clamp(speed / max_visual_speed, 0.0f, 1.0f);
+
+	vec4 blue   = vec4(0.0, 0.5, 1.0, 1.0);
+	vec4 yellow = vec4(1.0, 1.0, 0.0, 1.0);
+	vec4 orange = vec4(1.0, 0.5, 0.0, 1.0);
+	vec4 red    = vec4(1.0, 0.0, 0.0, 1.0);
+
+	if (t < 0.5) {
+		float local_t = t / 0.5;
+		v_Colour = mix(blue, yellow, local_t);
+	}
+	else if (t < 0.66) {
+		float local_t = (t - 0.33) / 0.33;
+		v_Colour = mix(yellow, orange, local_t);
+	}
+	else {
+		float local_t = (t - 0.66) / 0.34;
+		v_Colour = mix(orange, red, local_t);
+	}
+}
+
+
+#shader fragment
+
+in vec4 v_Colour;
+layout(location = 0) out vec4 f_Colour;
+
+void main()
+{
+	if (length(gl_PointCoord - vec2(0.5)) > 0.5)
+		discard;
+
+	f_Colour = v_Colour;
+}
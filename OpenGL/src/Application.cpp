@@ -26,6 +26,7 @@
 #include "simulations/TestClearColour.h"
 #include "simulations/TestTexture2D.h"
 #include "simulations/FluidSim2D.h"
+#include "simulations/FluidSim3D.h"
 
 struct AppState {
     GLFWwindow* window;
@@ -169,7 +170,10 @@ int main(void)
         app.simulationMenu = new simulation::SimulationMenu(app.currentSimulation);
         app.currentSimulation = app.simulationMenu;
 
-        app.simulationMenu->RegisterSimulation<simulation::FluidSim2D>("Start");
+        app.simulationMenu->RegisterSimulation<simulation::FluidSim2D<>>("Start");
+        app.simulationMenu->RegisterSimulation<simulation::FluidSim2D<double>>("Start (double precision)");
+        app.simulationMenu->RegisterSimulation<simulation::FluidSim2D<simulation::Half, float>>("Start (half storage)");
+        app.simulationMenu->RegisterSimulation<simulation::FluidSim3D>("Start 3D");
 
         // --- THE MAIN LOOP SWITCH ---
         #ifdef __EMSCRIPTEN__
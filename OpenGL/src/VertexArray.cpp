@@ -27,6 +27,24 @@ void VertexArray::AddBuffer(const VertexBuffer& vb, const VertexBufferLayout& la
 	}
 }
 
+/*
+	Binds a buffer where each attribute is stored as its own tightly packed block
+	(all positions, then all velocities, ...) rather than interleaved per vertex.
+*/
+void VertexArray::AddPlanarBuffer(const VertexBuffer& vb, const VertexBufferLayout& layout, unsigned int vertexCount) const
+{
+	Bind();
+	vb.Bind();
+	const auto& elements = layout.GetElements();
+	unsigned int offset = 0;
+	for (unsigned int i = 0; i < elements.size(); i++) {
+		const auto& element = elements[i];
+		GLCall(glVertexAttribPointer(i, element.count, element.type, element.normalised, 0, (const void*)(offset)));
+		GLCall(glEnableVertexAttribArray(i));
+		offset += element.count * VertexBufferElement::GetSizeOfType(element.type) * vertexCount;
+	}
+}
+
 void VertexArray::Bind() const
 {
 	GLCall(glBindVertexArray(m_RendererID));
@@ -11,6 +11,7 @@ public:
 	~VertexArray();
 
 	void AddBuffer(const VertexBuffer& vb, const VertexBufferLayout& layout) const;
+	void AddPlanarBuffer(const VertexBuffer& vb, const VertexBufferLayout& layout, unsigned int vertexCount) const;
 
 	void Bind() const;
 	void Unbind() const;
@@ -0,0 +1,83 @@
+#include "CellBinner.h"
+#include "Utils.h"
+
+namespace simulation {
+	// Below this many particles per chunk the histogram setup costs more than it saves
+	static constexpr int MIN_CHUNK_SIZE = 1024;
+
+	CellBinner::CellBinner()
+		: m_ChunkSize(MIN_CHUNK_SIZE), m_ChunkCount(1)
+	{
+	}
+
+	void CellBinner::Resize(int particleCount, int cellCount)
+	{
+		const int max_chunks = Utils::GetParallelThreadCount();
+		const int chunk_count = std::clamp(particleCount / MIN_CHUNK_SIZE, 1, max_chunks);
+		m_ChunkSize = (particleCount + chunk_count - 1) / chunk_count;
+		m_ChunkCount = chunk_count;
+
+		m_CellStart.resize(cellCount);
+		m_CellCount.resize(cellCount);
+
+		m_SortedIndices.resize(particleCount);
+		m_Histogram.resize(static_cast<size_t>(chunk_count) * cellCount);
+	}
+
+	void CellBinner::Build(const std::vector<int>& keys, int cellCount)
+	{
+		const int count = static_cast<int>(keys.size());
+		Resize(count, cellCount);
+
+		const int chunk_count = m_ChunkCount;
+		Utils::ParallelFill(m_Histogram.begin(), m_Histogram.end(), 0);
+
+		// Count the particles of each chunk per cell
+		Utils::ParallelFor(0, chunk_count, 1,
+			[&](int chunk) {
+				int* histogram = &m_Histogram[static_cast<size_t>(chunk) * cellCount];
+				const int end = std::min(count, (chunk + 1) * m_ChunkSize);
+				for (int i = chunk * m_ChunkSize; i < end; ++i) {
+					histogram[keys[i]]++;
+				}
+			}
+		);
+
+		// Total particles per cell
+		Utils::ParallelFor(0, cellCount, Utils::DEFAULT_GRAIN,
+			[&](int cell) {
+				int total = 0;
+				for (int chunk = 0; chunk < chunk_count; ++chunk) {
+					total += m_Histogram[static_cast<size_t>(chunk) * cellCount + cell];
+				}
+				m_CellCount[cell] = total;
+			}
+		);
+
+		Utils::ParallelScan(m_CellCount.begin(), m_CellCount.end(), m_CellStart.begin(), 0);
+
+		// Turn the histogram into each chunk's write cursor for every cell
+		Utils::ParallelFor(0, cellCount, Utils::DEFAULT_GRAIN,
+			[&](int cell) {
+				int offset = m_CellStart[cell];
+				for (int chunk = 0; chunk < chunk_count; ++chunk) {
+					int& slot = m_Histogram[static_cast<size_t>(chunk) * cellCount + cell];
+					int chunk_total = slot;
+					slot = offset;
+					offset += chunk_total;
+				}
+			}
+		);
+
+		// Scatter, walking each chunk in index order to keep the sort stable
+		Utils::ParallelFor(0, chunk_count, 1,
+			[&](int chunk) {
+				int* cursor = &m_Histogram[static_cast<size_t>(chunk) * cellCount];
+				const int end = std::min(count, (chunk + 1) * m_ChunkSize);
+				for (int i = chunk * m_ChunkSize; i < end; ++i) {
+					m_SortedIndices[cursor[keys[i]]++] = i;
+				}
+			}
+		);
+	}
+}
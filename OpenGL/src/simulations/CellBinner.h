@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+
+namespace simulation {
+	/*
+		Linear time binning of particles into cells.
+
+		Given one cell key per particle, Build() performs a stable counting sort:
+		per-chunk histograms, an exclusive prefix sum over the cell totals, then a
+		scatter. The result is, for every cell, a contiguous [start, start + count)
+		range into SortedIndices(). Within a cell particles stay in ascending index
+		order, so neighbour sums are summed in the same order on every run.
+	*/
+	class CellBinner
+	{
+	public:
+		CellBinner();
+
+		void Build(const std::vector<int>& keys, int cellCount);
+
+		inline int CellStart(int key) const { return m_CellStart[key]; }
+		inline int CellCount(int key) const { return m_CellCount[key]; }
+		inline int GetCellCount() const { return static_cast<int>(m_CellCount.size()); }
+		inline const std::vector<int>& SortedIndices() const { return m_SortedIndices; }
+
+	private:
+		void Resize(int particleCount, int cellCount);
+
+		std::vector<int> m_CellStart;
+		std::vector<int> m_CellCount;
+		std::vector<int> m_SortedIndices;
+
+		// Chunk-major histogram, reused as the per-chunk scatter cursor
+		std::vector<int> m_Histogram;
+		int m_ChunkSize;
+		int m_ChunkCount;
+	};
+}
@@ -0,0 +1,198 @@
+#include "ClusterPairList.h"
+#include "Utils.h"
+
+#include <cmath>
+
+namespace simulation {
+	// Dummy particles sit far enough away that every lane they touch is masked out
+	static constexpr float PADDING_POSITION = 1e10f;
+
+	ClusterPairList::ClusterPairList()
+		: m_ClusterSize(4), m_ClusterCount(0)
+	{
+	}
+
+	void ClusterPairList::SetClusterSize(int size)
+	{
+		m_ClusterSize = size <= 4 ? 4 : 8;
+	}
+
+	void ClusterPairList::BuildClusters(const CellBinner& grid, const AlignedVector<glm::vec2>& position)
+	{
+		const int N = m_ClusterSize;
+		const std::vector<int>& sorted = grid.SortedIndices();
+
+		// (first sorted index, member count) of every cluster, never spanning two cells
+		std::vector<glm::ivec2> members;
+		for (int cell = 0; cell < grid.GetCellCount(); ++cell) {
+			const int start = grid.CellStart(cell);
+			const int count = grid.CellCount(cell);
+			for (int k = 0; k < count; k += N) {
+				members.push_back(glm::ivec2(start + k, std::min(N, count - k)));
+			}
+		}
+
+		const int cluster_count = static_cast<int>(members.size());
+		m_ClusterCount = cluster_count;
+
+		const size_t slot_count = static_cast<size_t>(cluster_count) * N;
+		m_Index.resize(slot_count);
+		m_X.resize(slot_count);
+		m_Y.resize(slot_count);
+		m_VX.resize(slot_count);
+		m_VY.resize(slot_count);
+		m_Density.resize(slot_count);
+		m_Pressure.resize(slot_count);
+		m_Bounds.resize(cluster_count);
+		m_SortedToCluster.resize(sorted.size());
+
+		Utils::ParallelFor(0, m_ClusterCount, Utils::DEFAULT_GRAIN,
+			[&](int cluster) {
+				const glm::ivec2 member = members[cluster];
+				glm::vec2 box_min(PADDING_POSITION);
+				glm::vec2 box_max(-PADDING_POSITION);
+
+				for (int s = 0; s < N; ++s) {
+					const int slot = cluster * N + s;
+					if (s < member.y) {
+						const int idx = sorted[member.x + s];
+						m_SortedToCluster[member.x + s] = cluster;
+						m_Index[slot] = idx;
+						m_X[slot] = position[idx].x;
+						m_Y[slot] = position[idx].y;
+						box_min = glm::min(box_min, position[idx]);
+						box_max = glm::max(box_max, position[idx]);
+					} else {
+						m_Index[slot] = -1;
+						m_X[slot] = PADDING_POSITION;
+						m_Y[slot] = PADDING_POSITION;
+					}
+				}
+				m_Bounds[cluster] = glm::vec4(box_min, box_max);
+			}
+		);
+	}
+
+	template <int N>
+	void ClusterPairList::DensityTiles(const Params& params, AlignedVector<float>& density) const
+	{
+		Utils::ParallelFor(0, m_ClusterCount, Utils::DEFAULT_GRAIN,
+			[&](int ci) {
+				const float* xi = &m_X[ci * N];
+				const float* yi = &m_Y[ci * N];
+				float sum[N] = {};
+
+				for (int p = m_Pairs.Begin(ci); p < m_Pairs.End(ci); ++p) {
+					const int cj = m_Pairs.entries[p];
+					const float* xj = &m_X[cj * N];
+					const float* yj = &m_Y[cj * N];
+
+					for (int s = 0; s < N; ++s) {
+						for (int t = 0; t < N; ++t) {
+							const float dx = xi[s] - xj[t];
+							const float dy = yi[s] - yj[t];
+							const float dist2 = dx * dx + dy * dy;
+
+							// Out of range lanes contribute a zero term
+							const float term = params.R2 - std::min(dist2, params.R2);
+							sum[s] += term * term * term;
+						}
+					}
+				}
+
+				for (int s = 0; s < N; ++s) {
+					const int idx = m_Index[ci * N + s];
+					if (idx >= 0)
+						density[idx] = params.mass * params.poly6 * sum[s];
+				}
+			}
+		);
+	}
+
+	template <int N>
+	void ClusterPairList::ForceTiles(const Params& params, AlignedVector<glm::vec2>& F_pressure, AlignedVector<glm::vec2>& F_viscosity) const
+	{
+		Utils::ParallelFor(0, m_ClusterCount, Utils::DEFAULT_GRAIN,
+			[&](int ci) {
+				const int base_i = ci * N;
+				float fpx[N] = {}, fpy[N] = {};
+				float fvx[N] = {}, fvy[N] = {};
+
+				for (int p = m_Pairs.Begin(ci); p < m_Pairs.End(ci); ++p) {
+					const int base_j = m_Pairs.entries[p] * N;
+
+					for (int s = 0; s < N; ++s) {
+						for (int t = 0; t < N; ++t) {
+							const float dx = m_X[base_i + s] - m_X[base_j + t];
+							const float dy = m_Y[base_i + s] - m_Y[base_j + t];
+							const float dist2 = dx * dx + dy * dy;
+
+							// Masked lanes are moved onto the kernel edge, where every term is zero
+							const bool active = dist2 < params.R2 && dist2 > 1e-6f;
+							const float r = std::sqrt(active ? dist2 : params.R2);
+							const float term = params.h - r;
+
+							const float gradient = params.spiky * term * term / r;
+							const float viscosity_laplacian = params.muller * term;
+
+							const float inv_density = 1.0f / m_Density[base_j + t];
+							const float pressure_avg = 0.5f * (m_Pressure[base_i + s] + m_Pressure[base_j + t]) * inv_density;
+							fpx[s] += -params.mass * pressure_avg * gradient * dx;
+							fpy[s] += -params.mass * pressure_avg * gradient * dy;
+
+							const float visc = params.mass * inv_density * viscosity_laplacian;
+							fvx[s] += (m_VX[base_j + t] - m_VX[base_i + s]) * visc;
+							fvy[s] += (m_VY[base_j + t] - m_VY[base_i + s]) * visc;
+						}
+					}
+				}
+
+				for (int s = 0; s < N; ++s) {
+					const int idx = m_Index[base_i + s];
+					if (idx >= 0) {
+						F_pressure[idx] = glm::vec2(fpx[s], fpy[s]);
+						F_viscosity[idx] = params.viscosity * glm::vec2(fvx[s], fvy[s]);
+					}
+				}
+			}
+		);
+	}
+
+	void ClusterPairList::ComputeDensity(const Params& params, AlignedVector<float>& density) const
+	{
+		if (m_ClusterSize == 4)
+			DensityTiles<4>(params, density);
+		else
+			DensityTiles<8>(params, density);
+	}
+
+	void ClusterPairList::ComputeForces(const Params& params, const ParticleStore& particles,
+		AlignedVector<glm::vec2>& F_pressure, AlignedVector<glm::vec2>& F_viscosity)
+	{
+		// Gather the fields the force tiles read now that density and pressure are known
+		const int N = m_ClusterSize;
+		Utils::ParallelFor(0, m_ClusterCount, Utils::DEFAULT_GRAIN,
+			[&](int cluster) {
+				for (int slot = cluster * N; slot < (cluster + 1) * N; ++slot) {
+					const int idx = m_Index[slot];
+					if (idx >= 0) {
+						m_VX[slot] = particles.velocity[idx].x;
+						m_VY[slot] = particles.velocity[idx].y;
+						m_Density[slot] = particles.density[idx];
+						m_Pressure[slot] = particles.pressure[idx];
+					} else {
+						m_VX[slot] = 0.0f;
+						m_VY[slot] = 0.0f;
+						m_Density[slot] = 1.0f;
+						m_Pressure[slot] = 0.0f;
+					}
+				}
+			}
+		);
+
+		if (N == 4)
+			ForceTiles<4>(params, F_pressure, F_viscosity);
+		else
+			ForceTiles<8>(params, F_pressure, F_viscosity);
+	}
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "CellBinner.h"
+#include "NeighbourList.h"
+#include "ParticleStore.h"
+
+#include "glm/glm.hpp"
+
+#include <vector>
+#include <algorithm>
+
+namespace simulation {
+	/*
+		Cluster pair neighbour list in the style of GROMACS.
+
+		The particles of every cell are split into clusters of a fixed size (4 or 8) and
+		copied into cluster-major arrays, padding the last cluster of a cell with dummy
+		particles far outside the domain. A cluster pair is kept when the bounding boxes
+		of the two clusters are within the smoothing radius. The kernels then evaluate
+		whole cluster x cluster tiles with fixed trip counts, masking out lanes that are
+		out of range instead of branching on them.
+	*/
+	class ClusterPairList
+	{
+	public:
+		struct Params {
+			float h;
+			float R2;
+			float mass;
+			float poly6;
+			float spiky;
+			float muller;
+			float viscosity;
+		};
+
+		ClusterPairList();
+
+		void SetClusterSize(int size);
+		inline int GetClusterSize() const { return m_ClusterSize; }
+
+		// Groups the particles of each cell into clusters and gathers their positions
+		void BuildClusters(const CellBinner& grid, const AlignedVector<glm::vec2>& position);
+
+		/*
+			Keeps every cluster pair whose bounding boxes are closer than the radius.
+			forEachCandidateRange(position, func) must call func(begin, end) for the ranges
+			of SortedIndices() around position, as FluidSim2D::ForEachCandidateRange does.
+		*/
+		template <typename RangeFunc>
+		void BuildPairs(float radius, RangeFunc forEachCandidateRange)
+		{
+			const float radius2 = radius * radius;
+			auto for_each_pair = [&](int ci, auto&& func) {
+				const glm::vec4& box_i = m_Bounds[ci];
+				forEachCandidateRange(glm::vec2(m_X[ci * m_ClusterSize], m_Y[ci * m_ClusterSize]), [&](int begin, int end) {
+					if (begin == end) return;
+					for (int cj = m_SortedToCluster[begin]; cj <= m_SortedToCluster[end - 1]; ++cj) {
+						const glm::vec4& box_j = m_Bounds[cj];
+						const float dx = std::max(0.0f, std::max(box_i.x - box_j.z, box_j.x - box_i.z));
+						const float dy = std::max(0.0f, std::max(box_i.y - box_j.w, box_j.y - box_i.w));
+						if (dx * dx + dy * dy < radius2)
+							func(cj);
+					}
+				});
+			};
+
+			m_Pairs.Build(m_ClusterCount,
+				[&](int ci) {
+					int count = 0;
+					for_each_pair(ci, [&](int) { count++; });
+					return count;
+				},
+				[&](int ci, int* out) {
+					for_each_pair(ci, [&](int cj) { *out++ = cj; });
+				}
+			);
+		}
+
+		void ComputeDensity(const Params& params, AlignedVector<float>& density) const;
+		void ComputeForces(const Params& params, const ParticleStore& particles,
+			AlignedVector<glm::vec2>& F_pressure, AlignedVector<glm::vec2>& F_viscosity);
+
+		inline int GetClusterCount() const { return m_ClusterCount; }
+		inline int GetPairCount() const { return m_Pairs.Size(); }
+
+	private:
+		template <int N>
+		void DensityTiles(const Params& params, AlignedVector<float>& density) const;
+		template <int N>
+		void ForceTiles(const Params& params, AlignedVector<glm::vec2>& F_pressure, AlignedVector<glm::vec2>& F_viscosity) const;
+
+		int m_ClusterSize;
+
+		// Cluster-major particle data, m_ClusterSize slots per cluster
+		AlignedVector<int> m_Index;
+		AlignedVector<float> m_X, m_Y;
+		AlignedVector<float> m_VX, m_VY;
+		AlignedVector<float> m_Density, m_Pressure;
+
+		// (min x, min y, max x, max y) of each cluster
+		std::vector<glm::vec4> m_Bounds;
+		std::vector<int> m_SortedToCluster;
+		int m_ClusterCount;
+
+		NeighbourList<int> m_Pairs;
+	};
+}
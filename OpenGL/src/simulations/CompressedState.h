@@ -0,0 +1,138 @@
+#pragma once
+
+#include "ParticleStore.h"
+#include "Half.h"
+
+#include "glm/glm.hpp"
+
+#include <cmath>
+#include <cstdint>
+
+namespace simulation {
+	/*
+		Compressed copy of the particle state the neighbour loops read, 12 bytes per
+		particle instead of 24 for the float store. Only neighbours are decoded from it;
+		the particle a loop is computing for, and integration, keep full precision.
+
+		Positions are 16 bits per axis: the top 2 bits hold the grid cell coordinate
+		modulo 4 and the low 14 bits the fixed-point offset inside that cell. Candidates
+		are never more than 2 cells from the particle being updated (1 for a grid
+		stencil, 2 for a Verlet list within its skin), so the low cell bits are enough to
+		recover the neighbour's cell relative to it. A distance of 2 cells is ambiguous in
+		sign but is always beyond the cell size, and the cell size is at least h, so such
+		pairs never interact either way. This relies on every particle being inside the
+		grid, which the walls guarantee for the dense grid.
+
+		Velocity, density and pressure are stored as fp16.
+
+		Error bound against the fp32 path, for cell size s (h, or h * (1 + skin) with
+		Verlet lists):
+			position   |error| <= s / 2^15 per axis (round to nearest), 6.4e-6 at the
+			           default s = 0.208, i.e. 4e-5 h
+			velocity, density, pressure
+			           relative error <= 2^-11 (4.9e-4) for normal halves; values below
+			           6.1e-5 (pressure near rest density) have absolute error <= 2^-25
+		Per pair, the kernel value and gradient move by at most |W'| or |W''| times the
+		position error, and the force terms pick up the relative errors of the fields
+		they read. Density is a sum of positive terms, so it keeps their relative error:
+		at most 1e-4 with the default parameters. Forces are sums of terms that largely
+		cancel, so their error is bounded against the size of a typical force rather
+		than the particle's own net force: within 5e-3 of the RMS pressure and viscous
+		force over all particles, measured over the first 400 steps of the default
+		scene. A particle whose net force is close to zero can therefore see a large
+		relative error in it.
+	*/
+	struct CompressedNeighbourState
+	{
+		static constexpr int OFFSET_BITS = 14;
+		static constexpr int OFFSET_SCALE = 1 << OFFSET_BITS;
+		static constexpr uint16_t OFFSET_MASK = OFFSET_SCALE - 1;
+		static constexpr int BYTES_PER_PARTICLE = 2 * sizeof(uint16_t) + 4 * sizeof(Half);
+
+		// Full precision position of a particle, relative to its own cell
+		struct Frame {
+			glm::ivec2 cell;
+			glm::vec2 offset;
+		};
+
+		AlignedVector<uint16_t> x, y;
+		AlignedVector<Half> vx, vy;
+		AlignedVector<Half> density, pressure;
+
+		float origin = 0.0f;
+		float cellSize = 1.0f;
+		float invCellSize = 1.0f;
+
+		void Resize(int count)
+		{
+			x.resize(count);
+			y.resize(count);
+			vx.resize(count);
+			vy.resize(count);
+			density.resize(count);
+			pressure.resize(count);
+		}
+
+		// Positions must be re-encoded after the cell size changes
+		void SetGrid(float grid_origin, float cell_size)
+		{
+			origin = grid_origin;
+			cellSize = cell_size;
+			invCellSize = 1.0f / cell_size;
+		}
+
+		void StorePosition(int i, const glm::vec2& position)
+		{
+			x[i] = EncodeAxis((position.x - origin) * invCellSize);
+			y[i] = EncodeAxis((position.y - origin) * invCellSize);
+		}
+
+		void StoreFields(int i, const glm::vec2& velocity, float particle_density, float particle_pressure)
+		{
+			vx[i] = velocity.x;
+			vy[i] = velocity.y;
+			density[i] = particle_density;
+			pressure[i] = particle_pressure;
+		}
+
+		Frame MakeFrame(const glm::vec2& position) const
+		{
+			const glm::vec2 cells = (position - origin) * invCellSize;
+			const glm::vec2 cell = glm::floor(cells);
+			return Frame{ glm::ivec2(cell), cells - cell };
+		}
+
+		// Position of frame's particle minus the position of neighbour j
+		glm::vec2 Difference(const Frame& frame, int j) const
+		{
+			return glm::vec2(DecodeAxis(x[j], frame.cell.x, frame.offset.x),
+				DecodeAxis(y[j], frame.cell.y, frame.offset.y)) * cellSize;
+		}
+
+		glm::vec2 Velocity(int j) const { return glm::vec2(float(vx[j]), float(vy[j])); }
+		float Density(int j) const { return density[j]; }
+		float Pressure(int j) const { return pressure[j]; }
+
+	private:
+		static inline uint16_t EncodeAxis(float cells)
+		{
+			int cell = static_cast<int>(std::floor(cells));
+			int offset = static_cast<int>((cells - cell) * OFFSET_SCALE + 0.5f);
+
+			// Rounding up to the far edge puts the particle at the origin of the next cell
+			if (offset >= OFFSET_SCALE) {
+				offset = 0;
+				cell++;
+			}
+			return static_cast<uint16_t>(((cell & 3) << OFFSET_BITS) | offset);
+		}
+
+		// Offset in cells from the neighbour to the frame's particle along one axis
+		static inline float DecodeAxis(uint16_t bits, int frame_cell, float frame_offset)
+		{
+			int delta = ((bits >> OFFSET_BITS) - frame_cell) & 3;
+			delta = delta == 3 ? -1 : delta;
+			return frame_offset - (static_cast<float>(delta) + static_cast<float>(bits & OFFSET_MASK) * (1.0f / OFFSET_SCALE));
+		}
+	};
+}
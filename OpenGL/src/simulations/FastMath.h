@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+	#include <xmmintrin.h>
+	#define SIMULATION_HAS_RSQRT_ESTIMATE 1
+#endif
+
+namespace simulation {
+	/*
+		Approximate 1 / sqrt(x) for x > 0: a starting estimate refined by one
+		Newton-Raphson step. On x86 the estimate is rsqrtss (12 bits), leaving a relative
+		error below 5e-7. Elsewhere, including wasm, it is the bit-level estimate with
+		Lomont's constant, leaving a relative error below 1.8e-3.
+	*/
+	inline float FastInverseSqrt(float x)
+	{
+#if defined(SIMULATION_HAS_RSQRT_ESTIMATE)
+		const float estimate = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+#else
+		uint32_t bits;
+		std::memcpy(&bits, &x, sizeof(bits));
+		bits = 0x5F375A86u - (bits >> 1);
+		float estimate;
+		std::memcpy(&estimate, &bits, sizeof(estimate));
+#endif
+		return estimate * (1.5f - 0.5f * x * estimate * estimate);
+	}
+
+	// Double has no fast estimate worth its error, so this is exact
+	inline double FastInverseSqrt(double x)
+	{
+		return 1.0 / std::sqrt(x);
+	}
+}
@@ -5,33 +5,50 @@
 
 #include "glm/glm.hpp"
 #include "glm/gtc/matrix_transform.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
 namespace simulation {
-	FluidSim2D::FluidSim2D()
+	template <typename Storage, typename Compute>
+	FluidSim2D<Storage, Compute>::FluidSim2D()
+		: FluidSim2D(true)
+	{
+	}
+
+	template <typename Storage, typename Compute>
+	FluidSim2D<Storage, Compute>::FluidSim2D(bool createGpuBuffers)
 		: m_Proj(glm::ortho(0.0f, 960.0f, 0.0f, 540.0f, -1.0f, 1.0f)), 
 			m_View(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f))), 
-			m_TranslationA(200, 200, 0), m_TranslationB(400, 200, 0), prev_time(glfwGetTime()),
-			particles{std::vector<Particle>(SimulationConstants::NO_OF_PARTICLES)}
+			m_TranslationA(200, 200, 0), m_TranslationB(400, 200, 0), prev_time(glfwGetTime())
 	{
+		particles.Resize(SimulationConstants::NO_OF_PARTICLES);
 
-		// Randomly initialise the position of the particles
+		// Randomly initialise the position of the particles, the same way every time
+		uint32_t jitter = 2463534242u;
 		for (int i = 0; i < SimulationConstants::NO_OF_PARTICLES; ++i) {
 			float x = (i % Init::PPR) * Init::SPACING_X / Init::PPR + Init::START_X;
 			float y = (i / Init::PPR) * Init::SPACING_Y / Init::PPR + Init::START_Y;
 
-			x += ((std::rand() % 100) / 100.0f) * 0.01f;
-			y += ((std::rand() % 100) / 100.0f) * 0.01f;
+			x += ((NextJitter(jitter) % 100) / 100.0f) * 0.01f;
+			y += ((NextJitter(jitter) % 100) / 100.0f) * 0.01f;
 
-			particles[i].position = glm::vec2(x, y);
+			particles.position[i] = glm::vec2(x, y);
 
-			particles[i].density = 0.0f;
-			particles[i].pressure = 0.0f;
+			particles.density[i] = Storage(0.0f);
+			particles.pressure[i] = Storage(0.0f);
 
-			particles[i].F_pressure = glm::vec2(0.0f);
-			particles[i].F_viscosity = glm::vec2(0.0f);
-			particles[i].F_other = glm::vec2(0.0f);
+			particles.F_pressure[i] = Vec(0.0f);
+			particles.F_viscosity[i] = Vec(0.0f);
+			particles.cold.F_other[i] = Vec(0.0f);
 
-			particles[i].colour = glm::vec3(0.0f, 0.5f, 1.0f);
+			particles.cold.colour[i] = glm::vec3(0.0f, 0.5f, 1.0f);
 		}
+		UpdateSpatialHashGrid(UpdateParams());
+
+		if (!createGpuBuffers)
+			return;
 
 		GLCall(GL_PROGRAM_POINT_SIZE);
 		GLCall(glEnable(GL_BLEND));
@@ -40,260 +57,1368 @@ namespace simulation {
 		m_Shader = std::make_unique<Shader>("res/shaders/Fluid.shader");
 		m_VAO = std::make_unique<VertexArray>();
 
-		m_VertexBuffer = std::make_unique<VertexBuffer>(nullptr, sizeof(Particle) * SimulationConstants::NO_OF_PARTICLES);
+		// Only the fields the shader reads are uploaded, one planar block per attribute
+		m_VertexBuffer = std::make_unique<VertexBuffer>(nullptr, 2 * sizeof(glm::vec2) * SimulationConstants::NO_OF_PARTICLES);
 		VertexBufferLayout layout;
 		layout.Push<float>(2);	// Position
 		layout.Push<float>(2);	// Velocity
-		layout.Push<float>(2);	// Acceleration
-		layout.Push<float>(1);	// Density
-		layout.Push<float>(1);	// Pressure
-		layout.Push<float>(2);	// Force of pressure
-		layout.Push<float>(2);	// Force of viscocity
-		layout.Push<float>(2);	// Force of other
-		layout.Push<float>(3);	// Colour
-
-		m_VAO->AddBuffer(*m_VertexBuffer, layout);
+
+		m_VAO->AddPlanarBuffer(*m_VertexBuffer, layout, SimulationConstants::NO_OF_PARTICLES);
 		m_Shader->Bind();
 	}
-	FluidSim2D::~FluidSim2D() {}
+	template <typename Storage, typename Compute>
+	FluidSim2D<Storage, Compute>::~FluidSim2D() {}
 
-	void FluidSim2D::UpdateSpatialHashGrid()
+	/*
+		Steps an off screen solver from the initial state on the scalar per-particle passes
+		with the pair cache and without Verlet lists. Compressed neighbour state only
+		exists in those passes, so every row uses them and rows differ only in how the
+		state is stored. The neighbour traffic is
+		estimated, not measured: the hot state the density and force loops read for every
+		candidate they visit. At this particle count the state stays in cache, so the
+		rate follows the step time rather than memory bandwidth.
+	*/
+	template <typename Storage, typename Compute>
+	PrecisionBenchmark FluidSim2D<Storage, Compute>::RunBenchmark(const char* name, int steps, bool compressed)
 	{
-		// Rest and fill the spatial hash grid
-		Utils::ParallelFill(spatialHash.begin(), spatialHash.end(), std::array<int, 2>{INT_MAX, INT_MAX});
-		Utils::ParallelForEach(iter_idx.begin(), iter_idx.end(),
-			[&](int i) {
-				const Particle& particle = particles[i];
-				int coord_x = std::floor((particle.position.x + 1) / PhysicsConstants::SMOOTHING_RADIUS);
-				int coord_y = std::floor((particle.position.y + 1) / PhysicsConstants::SMOOTHING_RADIUS);
+		const auto was = std::make_tuple(SimulationConstants::COMPRESS_NEIGHBOUR_STATE, SimulationConstants::USE_CELL_TILES,
+			SimulationConstants::USE_CLUSTER_PAIRS, SimulationConstants::USE_VERLET_LISTS, SimulationConstants::USE_PAIR_CACHE);
+		SimulationConstants::COMPRESS_NEIGHBOUR_STATE = compressed;
+		SimulationConstants::USE_CELL_TILES = false;
+		SimulationConstants::USE_CLUSTER_PAIRS = false;
+		SimulationConstants::USE_VERLET_LISTS = false;
+		SimulationConstants::USE_PAIR_CACHE = true;
+
+		FluidSim2D sim(false);
+		sim.simdLevel = SimdLevel::Scalar;
+
+		const auto start = std::chrono::steady_clock::now();
+		for (int step = 0; step < steps; ++step) {
+			sim.OnUpdate();
+		}
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		long long candidates = 0;
+		for (int i = 0; i < sim.particles.Size(); ++i) {
+			candidates += sim.CandidateCount(i, sim.particles.position[i]);
+		}
 
-				unsigned int hash_x = coord_x * SimulationConstants::PRIME1;
-				unsigned int hash_y = coord_y * SimulationConstants::PRIME2;
+		std::tie(SimulationConstants::COMPRESS_NEIGHBOUR_STATE, SimulationConstants::USE_CELL_TILES,
+			SimulationConstants::USE_CLUSTER_PAIRS, SimulationConstants::USE_VERLET_LISTS, SimulationConstants::USE_PAIR_CACHE) = was;
 
-				unsigned int raw_hash = hash_x ^ hash_y;
-;				int grid_hash = raw_hash % SimulationConstants::TABLE_SIZE;
+		PrecisionBenchmark result;
+		result.name = name;
+		result.hot_bytes = compressed ? CompressedNeighbourState::BYTES_PER_PARTICLE
+			: static_cast<int>(2 * sizeof(StorageVec) + 2 * sizeof(Storage));
+		result.ms_per_step = 1000.0 * seconds / steps;
+
+		// The density pass reads positions, the force pass the whole hot state
+		result.neighbour_bytes = double(candidates) * (sizeof(StorageVec) + result.hot_bytes);
+		result.estimated_gb_per_s = result.neighbour_bytes * steps / seconds * 1e-9;
+
+		result.positions.resize(sim.particles.Size());
+		for (int k = 0; k < sim.particles.Size(); ++k) {
+			result.positions[sim.particles.id[k]] = glm::dvec2(Vec(sim.particles.position[k]));
+		}
+		return result;
+	}
 
-				spatialHash[i] = { grid_hash, i };
+	template <typename T>
+	static inline glm::ivec2 GetCellCoord(const glm::vec<2, T>& position, float cell_size)
+	{
+		return GetCellCoord(position, SimulationConstants::DOMAIN_MIN, cell_size);
+	}
+
+	/*
+		The original fixed size modulo table. Only kept so the grid statistics can show
+		how many candidates its collisions used to cost.
+	*/
+	static inline int LegacyHashCell(int x, int y)
+	{
+		unsigned int hash_x = static_cast<unsigned int>(x) * SimulationConstants::PRIME1;
+		unsigned int hash_y = static_cast<unsigned int>(y) * SimulationConstants::PRIME2;
+
+		unsigned int raw_hash = hash_x ^ hash_y;
+		return raw_hash % SimulationConstants::LEGACY_TABLE_SIZE;
+	}
+
+	/*
+		Calls func(begin, end) for every range of SortedIndices() that may hold a particle
+		within `range` cells of position. The dense grid is row-major, so the cells of one
+		stencil row are adjacent after binning and each row is a single range. The sparse
+		grid looks every cell up in the cell map and skips the ones that are empty.
+	*/
+	template <typename Storage, typename Compute>
+	template <typename Func>
+	void FluidSim2D<Storage, Compute>::ForEachCandidateRange(const Vec& position, int range, Func&& func) const
+	{
+		ForEachCellRange(GetCellCoord(position, gridCellSize), range, func);
+	}
+
+	// As ForEachCandidateRange, for the cells within `range` of cell coord
+	template <typename Storage, typename Compute>
+	template <typename Func>
+	void FluidSim2D<Storage, Compute>::ForEachCellRange(const glm::ivec2& coord, int range, Func&& func) const
+	{
+		if (gridDense) {
+			gridLayout.ForEachRow(coord, range, [&](int first_cell, int last_cell) {
+				func(grid.CellStart(first_cell), grid.CellStart(last_cell) + grid.CellCount(last_cell));
+			});
+			return;
+		}
+
+		for (int j = -range; j <= range; ++j) {
+			for (int k = -range; k <= range; ++k) {
+				const int slot = cellMap.Find(glm::ivec2(coord.x + j, coord.y + k));
+				if (slot == -1) continue;
+
+				const int cell_start = grid.CellStart(slot);
+				func(cell_start, cell_start + grid.CellCount(slot));
 			}
-		);
-		Utils::ParallelSort(spatialHash.begin(), spatialHash.end(), std::less<std::array<int, 2>>());
+		}
+	}
 
-		// Reset and fill the indices grid
-		Utils::ParallelFill(indices.begin(), indices.end(), -1);
-		Utils::ParallelForEach(iter_idx.begin(), iter_idx.end(),
-			[&](int i) {
-				int prev_hash = i == 0 ? -1 : spatialHash[i - 1][0];
+	/*
+		Calls func(j) for every particle j that may lie within the smoothing radius of
+		particle i: its Verlet list when one is active, otherwise the grid stencil.
+	*/
+	template <typename Storage, typename Compute>
+	template <typename Func>
+	void FluidSim2D<Storage, Compute>::ForEachNeighbourCandidate(int i, const Vec& position, Func&& func) const
+	{
+		if (verletActive) {
+			for (int k = verletList.Begin(i); k < verletList.End(i); ++k) {
+				func(verletList.entries[k]);
+			}
+			return;
+		}
+
+		const std::vector<int>& sorted = grid.SortedIndices();
+		ForEachCandidateRange(position, 1, [&](int begin, int end) {
+			for (int k = begin; k < end; ++k) {
+				func(sorted[k]);
+			}
+		});
+	}
+
+	// Number of candidates ForEachNeighbourCandidate will visit for particle i
+	template <typename Storage, typename Compute>
+	int FluidSim2D<Storage, Compute>::CandidateCount(int i, const Vec& position) const
+	{
+		if (verletActive)
+			return verletList.End(i) - verletList.Begin(i);
+
+		int count = 0;
+		ForEachCandidateRange(position, 1, [&](int begin, int end) { count += end - begin; });
+		return count;
+	}
+
+	template <typename Storage, typename Compute>
+	void FluidSim2D<Storage, Compute>::UpdateSpatialHashGrid(const Params& params)
+	{
+		// The grid keeps the layout it was built with, queries between steps use it
+		gridDense = params.grid_dense;
+		gridCellSize = params.grid_cell_size;
+		gridLayout.width = params.grid_width;
+
+		if (gridDense) {
+			Utils::ParallelFor(0, particles.Size(), PassGrain(PassLoop::GridKeys),
+				[&](int i) {
+					cellKeys[i] = gridLayout.Key(GetCellCoord(particles.position[i], gridCellSize));
+				}
+			);
+			grid.Build(cellKeys, gridLayout.CellCount());
+		} else {
+			// Every particle could sit in its own cell, so size the map from the live count
+			cellMap.Reset(particles.Size());
+			for (int i = 0; i < particles.Size(); ++i) {
+				cellKeys[i] = cellMap.Insert(GetCellCoord(particles.position[i], gridCellSize));
+			}
+			grid.Build(cellKeys, cellMap.Size());
+		}
+		gridSlotsValid = true;
+
+		if (params.settings.collect_grid_stats)
+			MeasureGridStats(params);
+	}
+
+	static inline unsigned int SpreadBits(unsigned int v)
+	{
+		v &= 0x0000FFFF;
+		v = (v | (v << 8)) & 0x00FF00FF;
+		v = (v | (v << 4)) & 0x0F0F0F0F;
+		v = (v | (v << 2)) & 0x33333333;
+		v = (v | (v << 1)) & 0x55555555;
+		return v;
+	}
+
+	static inline unsigned int MortonKey(unsigned int x, unsigned int y)
+	{
+		return SpreadBits(x) | (SpreadBits(y) << 1);
+	}
 
-				if (spatialHash[i][0] != INT_MAX &&
-					spatialHash[i][0] != prev_hash) {
-					indices[spatialHash[i][0]] = i;
+	static inline unsigned int HilbertKey(unsigned int x, unsigned int y)
+	{
+		constexpr unsigned int n = 1u << 16;
+		unsigned int d = 0;
+		for (unsigned int s = n / 2; s > 0; s /= 2) {
+			unsigned int rx = (x & s) > 0;
+			unsigned int ry = (y & s) > 0;
+			d += s * s * ((3 * rx) ^ ry);
+
+			// Rotate the quadrant so the curve stays continuous
+			if (ry == 0) {
+				if (rx == 1) {
+					x = n - 1 - x;
+					y = n - 1 - y;
 				}
+				std::swap(x, y);
+			}
+		}
+		return d;
+	}
+
+	/*
+		Permutes every particle array into Morton or Hilbert order of the particles' cells,
+		so particles that are close in space are also close in memory.
+	*/
+	template <typename Storage, typename Compute>
+	void FluidSim2D<Storage, Compute>::ReorderParticles(const Params& params)
+	{
+		const int count = particles.Size();
+		std::vector<glm::ivec2> coords(count);
+		glm::ivec2 min_coord(INT_MAX);
+		for (int i = 0; i < count; ++i) {
+			coords[i] = GetCellCoord(particles.position[i], params.settings.smoothing_radius);
+			min_coord = glm::min(min_coord, coords[i]);
+		}
+
+		std::vector<std::pair<unsigned int, int>> keys(count);
+		Utils::ParallelFor(0, count, PassGrain(PassLoop::ReorderKeys),
+			[&](int i) {
+				const unsigned int x = std::min<unsigned int>(coords[i].x - min_coord.x, 0xFFFF);
+				const unsigned int y = std::min<unsigned int>(coords[i].y - min_coord.y, 0xFFFF);
+				const unsigned int key = params.settings.reorder_curve == ReorderCurve::Hilbert
+					? HilbertKey(x, y) : MortonKey(x, y);
+				keys[i] = { key, i };
 			}
 		);
+		Utils::ParallelSort(keys.begin(), keys.end(), std::less<std::pair<unsigned int, int>>());
+
+		std::vector<int> order(count);
+		for (int k = 0; k < count; ++k) {
+			order[k] = keys[k].second;
+		}
+		particles.Permute(order);
+		loadBalancer.Permute(order);
+
+		// Any existing neighbour list refers to the old slots, and the permuted arrays
+		// were allocated on this thread's node
+		verletActive = false;
+		gridSlotsValid = false;
+		numaPlaced = false;
 	}
 
 	/*
-		Naively updates the density of each particle.
+		Counts the candidates a 3x3 stencil walk visits on the current grid and what the
+		old modulo hash table would have visited. Its buckets also held particles from
+		colliding cells (and from cells outside the domain), all discarded by the
+		distance test.
 	*/
-	void FluidSim2D::UpdateParticleDensity() 
+	template <typename Storage, typename Compute>
+	void FluidSim2D<Storage, Compute>::MeasureGridStats(const Params& params)
 	{
-		// Iterate through all particles and calculate density
-		float R2 = PhysicsConstants::SMOOTHING_RADIUS * PhysicsConstants::SMOOTHING_RADIUS;
-		// MOVE KERNAL CONSTANT HERE
-		for (int i = 0; i < particles.size(); ++i) {
-			Particle& particle = particles[i];
-			particle.density = 0.0f;
+		std::vector<int> hashed_counts(SimulationConstants::LEGACY_TABLE_SIZE, 0);
+		for (int i = 0; i < particles.Size(); ++i) {
+			const glm::ivec2 coord = GetCellCoord(particles.position[i], gridCellSize);
+			hashed_counts[LegacyHashCell(coord.x, coord.y)]++;
+		}
 
-			for (int j = 0; j < particles.size(); ++j) {
-				Particle& neighbour = particles[j];
-				glm::vec2 diff = particle.position - neighbour.position;
-				float dist2 = glm::dot(diff, diff);
+		const Compute R2 = params.R2;
+		const std::vector<int>& sorted = grid.SortedIndices();
 
-				if (R2 > dist2) {
-					float term = R2 - dist2;
-					particle.density += PhysicsConstants::MASS * PhysicsConstants::Poly6Kernal() * term * term * term;
+		gridStats = GridStats();
+		for (int i = 0; i < particles.Size(); ++i) {
+			const glm::ivec2 coord = GetCellCoord(particles.position[i], gridCellSize);
+			for (int j = -1; j <= 1; ++j) {
+				for (int k = -1; k <= 1; ++k) {
+					gridStats.hashed_candidates += hashed_counts[LegacyHashCell(coord.x + j, coord.y + k)];
 				}
 			}
+
+			ForEachCandidateRange(particles.position[i], 1, [&](int begin, int end) {
+				gridStats.exact_candidates += end - begin;
+
+				// How far apart in memory the interacting particles are
+				for (int k = begin; k < end; ++k) {
+					const int j = sorted[k];
+					const Vec diff = Vec(particles.position[i]) - Vec(particles.position[j]);
+					if (j != i && glm::dot(diff, diff) < R2) {
+						gridStats.neighbour_pairs++;
+						gridStats.neighbour_index_distance += std::abs(i - j);
+					}
+				}
+			});
 		}
 	}
 
-	void FluidSim2D::UpdateParticleDensitySHG()
+	/*
+		A Verlet list stays valid until some particle may have crossed into the search
+		radius from outside the skin, i.e. once the largest displacement since the
+		build exceeds half the skin.
+	*/
+	template <typename Storage, typename Compute>
+	bool FluidSim2D<Storage, Compute>::VerletListNeedsRebuild(const Params& params) const
 	{
-		float R2 = PhysicsConstants::SMOOTHING_RADIUS * PhysicsConstants::SMOOTHING_RADIUS;
+		const float skin = params.verlet_skin;
+		if (!verletActive || params.verlet_radius != verletRadius)
+			return true;
+
+		const Compute max_displacement2 = Utils::ParallelReduce(0, particles.Size(), 256, Compute(0),
+			[&](int begin, int end) {
+				Compute max2 = Compute(0);
+				for (int i = begin; i < end; ++i) {
+					const Vec displacement = Vec(particles.position[i]) - Vec(verletPositions[i]);
+					max2 = std::max(max2, glm::dot(displacement, displacement));
+				}
+				return max2;
+			},
+			[](Compute a, Compute b) { return std::max(a, b); }
+		);
+		return max_displacement2 > 0.25f * skin * skin;
+	}
 
-		Utils::ParallelForEach(iter_idx.begin(), iter_idx.end(),
+	template <typename Storage, typename Compute>
+	void FluidSim2D<Storage, Compute>::BuildVerletList()
+	{
+		verletRadius = gridCellSize;
+		const Compute search_radius2 = Compute(verletRadius) * Compute(verletRadius);
+		const std::vector<int>& sorted = grid.SortedIndices();
+
+		auto for_each_in_radius = [&](int i, auto&& func) {
+			const Vec position = particles.position[i];
+			ForEachCandidateRange(position, 1, [&](int begin, int end) {
+				for (int k = begin; k < end; ++k) {
+					const Vec diff = position - Vec(particles.position[sorted[k]]);
+					if (glm::dot(diff, diff) < search_radius2)
+						func(sorted[k]);
+				}
+			});
+		};
+
+		verletList.Build(particles.Size(),
 			[&](int i) {
-				Particle& particle = particles[i];
-				particle.density = 0.0f;
+				int count = 0;
+				for_each_in_radius(i, [&](int) { count++; });
+				return count;
+			},
+			[&](int i, int* out) {
+				for_each_in_radius(i, [&](int j) { *out++ = j; });
+			},
+			PassGrain(PassLoop::VerletBuild)
+		);
+
+		verletPositions.assign(particles.position.begin(), particles.position.end());
+		verletActive = true;
+		verletBuilds++;
+	}
 
-				// get the grid coordinate of that particle
-				int coord_x = std::floor((particle.position.x + 1) / PhysicsConstants::SMOOTHING_RADIUS);
-				int coord_y = std::floor((particle.position.y + 1) / PhysicsConstants::SMOOTHING_RADIUS);
+	// Makes room for every pair the density pass may record this step
+	template <typename Storage, typename Compute>
+	void FluidSim2D<Storage, Compute>::ReservePairCache(const Params& params)
+	{
+		if (params.settings.pair_cache) {
+			pairCache.Reserve(particles.Size(), [&](int i) { return CandidateCount(i, particles.position[i]); },
+				PassGrain(PassLoop::PairCacheReserve));
+		}
+		pairCache.valid = params.settings.pair_cache;
+		pairCache.half = params.symmetric_forces;
+	}
+
+	/*
+		Naively updates the density of each particle.
+	*/
+	template <typename Storage, typename Compute>
+	template <typename Kernel>
+	void FluidSim2D<Storage, Compute>::UpdateParticleDensity(const Params& params, const Kernel& kernel)
+	{
+		// Iterate through all particles and calculate density
+		const Compute R2 = params.R2;
+		const Compute mass = params.mass;
+		const int count = particles.Size();
+		for (int i = 0; i < count; ++i) {
+			const Vec position = particles.position[i];
+			Compute density = 0.0f;
 
-				// get surrounding grid coordinates
-				for (int j = -1; j <= 1; ++j) {
-					for (int k = -1; k <= 1; ++k) {
-						int target_x = coord_x + j;
-						int target_y = coord_y + k;
+			for (int j = 0; j < count; ++j) {
+				Vec diff = position - Vec(particles.position[j]);
+				Compute dist2 = glm::dot(diff, diff);
 
-						unsigned int hash_x = target_x * SimulationConstants::PRIME1;
-						unsigned int hash_y = target_y * SimulationConstants::PRIME2;
+				if (R2 > dist2) {
+					density += mass * kernel.Density(dist2);
+				}
+			}
+			particles.density[i] = density;
+		}
+	}
 
-						unsigned int raw_hash = hash_x ^ hash_y;
-						int target_grid_hash = raw_hash % SimulationConstants::TABLE_SIZE;
+	/*
+		Updates the density of each particle from its grid or Verlet candidates. With the
+		pair cache enabled, every pair inside the smoothing radius is also recorded with
+		its distance so later passes in the step do not have to search again.
 
-						int target_grid_start_idx = indices[target_grid_hash];
-						if (target_grid_start_idx == -1) continue;
-						while (target_grid_start_idx < spatialHash.size() &&
-							spatialHash[target_grid_start_idx][0] == target_grid_hash) {
-							int neighbour_id = spatialHash[target_grid_start_idx][1];
-							const Particle& neighbour = particles[neighbour_id];
+		Compressed reads neighbour positions from compressedState instead of the store,
+		see CompressNeighbourPositions. An approximate kernel records pair distances from
+		FastInverseSqrt.
+	*/
+	template <typename Storage, typename Compute>
+	template <typename Kernel, bool Compressed>
+	void FluidSim2D<Storage, Compute>::UpdateParticleDensitySHG(const Params& params, const Kernel& kernel)
+	{
+		ReservePairCache(params);
+		auto pass = [&](int begin, int end) {
+			UpdateParticleDensitySHG<Kernel, Compressed>(params, kernel, begin, end);
+		};
+		if (params.load_balance == LoadBalance::Off) {
+			Utils::ParallelForRange(0, particles.Size(), PassGrain(PassLoop::Density), pass);
+			return;
+		}
 
-							glm::vec2 diff = particle.position - neighbour.position;
-							float dist2 = glm::dot(diff, diff);
+		// Split by the previous step's counts, which this pass then overwrites
+		loadBalancer.Resize(particles.Size());
+		loadBalancer.Partition(particles.Size(), Utils::GetParallelThreadCount(), params.load_balance == LoadBalance::CostModel);
+		loadBalancer.Run(pass, densityBusy);
+	}
 
-							if (R2 > dist2) {
-								float term = R2 - dist2;
-								particle.density += PhysicsConstants::MASS * PhysicsConstants::Poly6Kernal() * term * term * term;
-							}
+	// Density of particles [begin, end) once the pair cache has been reserved
+	template <typename Storage, typename Compute>
+	template <typename Kernel, bool Compressed>
+	void FluidSim2D<Storage, Compute>::UpdateParticleDensitySHG(const Params& params, const Kernel& kernel, int begin, int end)
+	{
+		constexpr bool approximate = IsApproximateKernel<Kernel>::value;
+		const Compute R2 = params.R2;
+		const Compute mass = params.mass;
+
+		const bool record_pairs = pairCache.valid;
+		const bool half_pairs = pairCache.half;
+		const bool fused = params.fused;
+		const Compute rest_density = params.rest_density;
+		const Compute gas_constant = params.gas_constant;
+		int* const costs = params.load_balance == LoadBalance::CostModel ? loadBalancer.GetCosts(particles.Size()) : nullptr;
+
+		for (int i = begin; i < end; ++i) {
+			const Vec position = particles.position[i];
+			const CompressedNeighbourState::Frame frame = compressedState.MakeFrame(glm::vec2(position));
+			Compute density = 0.0f;
+			PairEntry<Compute>* pairs = record_pairs ? &pairCache.entries[pairCache.Begin(i)] : nullptr;
+			int pair_count = 0;
+			int candidates = 0;
+
+			ForEachNeighbourCandidate(i, position, [&](int neighbour_id) {
+				candidates++;
+				Vec diff;
+				if constexpr (Compressed)
+					diff = Vec(compressedState.Difference(frame, neighbour_id));
+				else
+					diff = position - Vec(particles.position[neighbour_id]);
+				Compute dist2 = glm::dot(diff, diff);
 
-							target_grid_start_idx++;
+				if (R2 > dist2) {
+					density += mass * kernel.Density(dist2);
+
+					// The symmetric force pass only needs each pair once
+					const bool keep = half_pairs ? neighbour_id > i : neighbour_id != i;
+					if (record_pairs && keep && dist2 > Compute(1e-6f)) {
+						if constexpr (approximate) {
+							const Compute inv_r = FastInverseSqrt(dist2);
+							pairs[pair_count++] = PairEntry<Compute>{ neighbour_id, dist2 * inv_r, inv_r };
+						} else {
+							const Compute r = sqrt(dist2);
+							pairs[pair_count++] = PairEntry<Compute>{ neighbour_id, r, Compute(1) / r };
 						}
 					}
 				}
-			}
-		);
+			});
+			particles.density[i] = density;
+			if (fused)
+				particles.pressure[i] = TaitPressure(Compute(particles.density[i]), rest_density, gas_constant);
+
+			if (record_pairs)
+				pairCache.counts[i] = pair_count;
+			// The force pass visits the same candidates, so both cost about this much
+			if (costs)
+				costs[i] = candidates;
+		}
 	}
 
 	/*
 		Computes the pressure of each particle using Tait's equation
 	*/
-	void FluidSim2D::UpdateParticlePressure() 
+	template <typename Storage, typename Compute>
+	void FluidSim2D<Storage, Compute>::UpdateParticlePressure(const Params& params)
 	{
-		Utils::ParallelForEach(iter_idx.begin(), iter_idx.end(), 
-			[&](int i) {
-				Particle& particle = particles[i];
-				float density_ratio = particles[i].density / PhysicsConstants::REST_DENSITY;
-				float r2 = density_ratio * density_ratio;
-				float r4 = r2 * r2;
-				float density_ratio7 = r4 * r2 * density_ratio;
-				
-				particle.pressure = std::max(PhysicsConstants::GASS_CONSTANT * (density_ratio7 - 1.0f), 0.0f);
+		if (NATIVE_FLOAT && GetSimdKernels(params.simd_level)) {
+			const int count = particles.Size();
+			const int block_count = (count + SimulationConstants::SIMD_BLOCK_SIZE - 1) / SimulationConstants::SIMD_BLOCK_SIZE;
+			Utils::ParallelFor(0, block_count, 1,
+				[&](int block) {
+					const int begin = block * SimulationConstants::SIMD_BLOCK_SIZE;
+					UpdateParticlePressure(params, begin, std::min(count, begin + SimulationConstants::SIMD_BLOCK_SIZE));
+				}
+			);
+			return;
+		}
+
+		Utils::ParallelForRange(0, particles.Size(), PassGrain(PassLoop::Pressure),
+			[&](int begin, int end) {
+				UpdateParticlePressure(params, begin, end);
 			}
 		);
 	}
 
+	template <typename Storage, typename Compute>
+	void FluidSim2D<Storage, Compute>::UpdateParticlePressure(const Params& params, int begin, int end)
+	{
+		if constexpr (NATIVE_FLOAT) {
+			if (const SimdKernels* kernels = GetSimdKernels(params.simd_level)) {
+				kernels->Pressure(particles.density.data(), particles.pressure.data(), begin, end,
+					params.settings.rest_density, params.settings.gas_constant);
+				return;
+			}
+		}
+
+		const Compute rest_density = params.rest_density;
+		const Compute gas_constant = params.gas_constant;
+		for (int i = begin; i < end; ++i) {
+			particles.pressure[i] = TaitPressure(Compute(particles.density[i]), rest_density, gas_constant);
+		}
+	}
+
 	/*
 		Naively calculates the force of pressure on each particle using Debrun's spiky kernel.
 	*/
-	void FluidSim2D::ComputeForces()
+	template <typename Storage, typename Compute>
+	template <typename Kernel, unsigned Terms>
+	void FluidSim2D<Storage, Compute>::ComputeForces(const Params& params, const Kernel& kernel)
 	{
-		float R2 = PhysicsConstants::SMOOTHING_RADIUS * PhysicsConstants::SMOOTHING_RADIUS;
-		for (int i = 0; i < particles.size(); ++i) {
-			Particle& particle = particles[i];
-			glm::vec2 f_pressure(0.0f);
-			glm::vec2 f_viscosity(0.0f);
-
-			for (int j = 0; j < particles.size(); ++j) {
-				const Particle& neighbour = particles[j];
-				glm::vec2 diff = particle.position - neighbour.position;
-				float dist2 = glm::dot(diff, diff);
+		constexpr bool viscosity = (Terms & TERM_VISCOSITY) != 0;
+		const Compute R2 = params.R2;
+		const Compute mass = params.mass;
+		const int count = particles.Size();
+		for (int i = 0; i < count; ++i) {
+			const Vec position = particles.position[i];
+			const Vec velocity = particles.velocity[i];
+			const Compute pressure = particles.pressure[i];
+			Vec f_pressure(0.0f);
+			Vec f_viscosity(0.0f);
+
+			for (int j = 0; j < count; ++j) {
+				Vec diff = position - Vec(particles.position[j]);
+				Compute dist2 = glm::dot(diff, diff);
 
 				if (dist2 < R2 && dist2 > 1e-6f) {
-					// Calculate Spiky gradiant and Laplacian of Viscosity
-					float eucalidian_dist = sqrt(dist2);
-					float term = PhysicsConstants::SMOOTHING_RADIUS - eucalidian_dist;
-					glm::vec2 direction = diff / eucalidian_dist;
+					// Calculate kernel gradiant and Laplacian of Viscosity
+					Compute eucalidian_dist = sqrt(dist2);
+					Vec direction = diff / eucalidian_dist;
 
-					glm::vec2 spiky_gradient = PhysicsConstants::SpikeyConstant() * term * term * direction;
-					const float viscosity_laplacian = PhysicsConstants::MullerConstant() * term;
+					Vec kernel_gradient = kernel.Gradient(eucalidian_dist) * direction;
 
 					// Calculate Forces
-					float pressure_avg = 0.5f * (particle.pressure + neighbour.pressure) / neighbour.density;
-					f_pressure += -PhysicsConstants::MASS * pressure_avg * spiky_gradient;
+					Compute pressure_avg = 0.5f * (pressure + particles.pressure[j]) / particles.density[j];
+					f_pressure += -mass * pressure_avg * kernel_gradient;
 
-					glm::vec2 v_rel = neighbour.velocity - particle.velocity;
-					f_viscosity += PhysicsConstants::MASS * (v_rel / neighbour.density) * viscosity_laplacian;
+					if constexpr (viscosity) {
+						Vec v_rel = Vec(particles.velocity[j]) - velocity;
+						f_viscosity += mass * (v_rel / Compute(particles.density[j])) * kernel.Laplacian(eucalidian_dist);
+					}
 				}
 			}
-			particle.F_pressure = f_pressure;
-			particle.F_viscosity = PhysicsConstants::VISCOCITY_COEFFICIENT * f_viscosity;
+			particles.F_pressure[i] = f_pressure;
+			if constexpr (viscosity)
+				particles.F_viscosity[i] = params.viscosity * f_viscosity;
 		}
 	}
 
 	/*
 		Update the pressure and viscous forces of each particle using an optimised
-		spatial hash grid approach and Debrun's spiky kernel.
+		spatial hash grid approach and Debrun's spiky kernel. Compressed reads every
+		neighbour field from compressedState. An approximate kernel replaces the sqrt and
+		divides of each pair with FastInverseSqrt and inverseDensity.
 	*/
 
-	void FluidSim2D::ComputeForcesSHG()
+	template <typename Storage, typename Compute>
+	template <typename Kernel, unsigned Terms, bool Compressed>
+	void FluidSim2D<Storage, Compute>::ComputeForcesSHG(const Params& params, const Kernel& kernel)
+	{
+		auto pass = [&](int begin, int end) {
+			ComputeForcesSHG<Kernel, Terms, Compressed>(params, kernel, begin, end);
+		};
+		if (params.load_balance == LoadBalance::Off) {
+			Utils::ParallelForRange(0, particles.Size(), PassGrain(PassLoop::Forces), pass);
+			return;
+		}
+
+		// The density pass has just counted this step's candidates
+		loadBalancer.Partition(particles.Size(), Utils::GetParallelThreadCount(), params.load_balance == LoadBalance::CostModel);
+		loadBalancer.Run(pass, forcesBusy);
+	}
+
+	// Forces on particles [begin, end), integrating them as well in a fused step
+	template <typename Storage, typename Compute>
+	template <typename Kernel, unsigned Terms, bool Compressed>
+	void FluidSim2D<Storage, Compute>::ComputeForcesSHG(const Params& params, const Kernel& kernel, int begin, int end)
 	{
-		float R2 = PhysicsConstants::SMOOTHING_RADIUS * PhysicsConstants::SMOOTHING_RADIUS;
+		constexpr bool viscosity = (Terms & TERM_VISCOSITY) != 0;
+		constexpr bool approximate = IsApproximateKernel<Kernel>::value;
+		const Compute R2 = params.R2;
+		const Compute mass = params.mass;
+		const bool fused = params.fused;
+		const bool stage_upload = params.stage_upload;
+		const IntegrateConstants<Compute> integrate = params.integrate;
+
+		for (int i = begin; i < end; ++i) {
+			const Vec position = particles.position[i];
+			const Vec velocity = particles.velocity[i];
+			const Compute pressure = particles.pressure[i];
+			const CompressedNeighbourState::Frame frame = compressedState.MakeFrame(glm::vec2(position));
+			Vec f_pressure(0.0f);
+			Vec f_viscosity(0.0f);
+
+			auto difference = [&](int neighbour_idx) {
+				if constexpr (Compressed)
+					return Vec(compressedState.Difference(frame, neighbour_idx));
+				else
+					return position - Vec(particles.position[neighbour_idx]);
+			};
+
+			auto accumulate = [&](int neighbour_idx, Compute eucalidian_dist, const Vec& direction) {
+				// Calculate kernel gradiant and Laplacian of Viscosity
+				Vec kernel_gradient = kernel.Gradient(eucalidian_dist) * direction;
+
+				// Calculate Forces
+				Compute neighbour_density, neighbour_inv_density, neighbour_pressure;
+				if constexpr (approximate) {
+					neighbour_inv_density = inverseDensity[neighbour_idx];
+				} else if constexpr (Compressed) {
+					neighbour_density = compressedState.Density(neighbour_idx);
+				} else {
+					neighbour_density = particles.density[neighbour_idx];
+				}
+				if constexpr (Compressed)
+					neighbour_pressure = compressedState.Pressure(neighbour_idx);
+				else
+					neighbour_pressure = particles.pressure[neighbour_idx];
+
+				Compute pressure_avg;
+				if constexpr (approximate)
+					pressure_avg = 0.5f * (pressure + neighbour_pressure) * neighbour_inv_density;
+				else
+					pressure_avg = 0.5f * (pressure + neighbour_pressure) / neighbour_density;
+				f_pressure += -mass * pressure_avg * kernel_gradient;
+
+				if constexpr (viscosity) {
+					Vec neighbour_velocity;
+					if constexpr (Compressed)
+						neighbour_velocity = Vec(compressedState.Velocity(neighbour_idx));
+					else
+						neighbour_velocity = particles.velocity[neighbour_idx];
+					Vec v_rel = neighbour_velocity - velocity;
+					if constexpr (approximate)
+						f_viscosity += mass * (v_rel * neighbour_inv_density) * kernel.Laplacian(eucalidian_dist);
+					else
+						f_viscosity += mass * (v_rel / neighbour_density) * kernel.Laplacian(eucalidian_dist);
+				}
+			};
 
-		Utils::ParallelForEach(iter_idx.begin(), iter_idx.end(),
+			if (pairCache.valid && !pairCache.half) {
+				// Pairs and distances were already resolved by the density pass
+				for (int k = pairCache.Begin(i); k < pairCache.End(i); ++k) {
+					const PairEntry<Compute>& pair = pairCache.entries[k];
+					accumulate(pair.neighbour, pair.r, difference(pair.neighbour) * pair.inv_r);
+				}
+			} else {
+				ForEachNeighbourCandidate(i, position, [&](int neighbour_idx) {
+					if (neighbour_idx == i) return;
+
+					Vec diff = difference(neighbour_idx);
+					Compute dist2 = glm::dot(diff, diff);
+
+					if (dist2 < R2 && dist2 > 1e-6f) {
+						if constexpr (approximate) {
+							const Compute inv_r = FastInverseSqrt(dist2);
+							accumulate(neighbour_idx, dist2 * inv_r, diff * inv_r);
+						} else {
+							Compute eucalidian_dist = sqrt(dist2);
+							accumulate(neighbour_idx, eucalidian_dist, diff / eucalidian_dist);
+						}
+					}
+				});
+			}
+
+			if (fused) {
+				IntegrateFused(integrate, stage_upload, i, f_pressure, params.viscosity * f_viscosity);
+				continue;
+			}
+			particles.F_pressure[i] = f_pressure;
+			if constexpr (viscosity)
+				particles.F_viscosity[i] = params.viscosity * f_viscosity;
+		}
+	}
+
+	/*
+		Quantises the positions neighbours are read at, relative to the current grid.
+		Runs after the grid (or Verlet list) is up to date and before the density pass.
+	*/
+	template <typename Storage, typename Compute>
+	void FluidSim2D<Storage, Compute>::CompressNeighbourPositions()
+	{
+		compressedState.Resize(particles.Size());
+		compressedState.SetGrid(SimulationConstants::DOMAIN_MIN, gridCellSize);
+		Utils::ParallelFor(0, particles.Size(), PassGrain(PassLoop::CompressPositions),
 			[&](int i) {
-				Particle& particle = particles[i];
-				glm::vec2 f_pressure(0.0f);
-				glm::vec2 f_viscosity(0.0f);
-
-				// get the grid coordinate of that particle
-				int coord_x = std::floor((particle.position.x + 1) / PhysicsConstants::SMOOTHING_RADIUS);
-				int coord_y = std::floor((particle.position.y + 1) / PhysicsConstants::SMOOTHING_RADIUS);
-
-				// get surrounding grid coordinates
-				for (int j = -1; j <= 1; ++j) {
-					for (int k = -1; k <= 1; ++k) {
-						int target_x = coord_x + j;
-						int target_y = coord_y + k;
-
-						unsigned int hash_x = target_x * SimulationConstants::PRIME1;
-						unsigned int hash_y = target_y * SimulationConstants::PRIME2;
-
-						unsigned int raw_hash = hash_x ^ hash_y;
-						int target_grid_hash = raw_hash % SimulationConstants::TABLE_SIZE;
-
-						int target_grid_idx = indices[target_grid_hash];
-						if (target_grid_idx == -1) continue;
-						while (target_grid_idx < spatialHash.size() &&
-							spatialHash[target_grid_idx][0] == target_grid_hash) {
-							int neighbour_idx = spatialHash[target_grid_idx][1];
-							if (neighbour_idx == i) {
-								target_grid_idx++;
-								continue;
-							}
+				compressedState.StorePosition(i, glm::vec2(Vec(particles.position[i])));
+			}
+		);
+	}
+
+	// Stores the fields the force pass reads per neighbour as fp16, after the pressure pass
+	template <typename Storage, typename Compute>
+	void FluidSim2D<Storage, Compute>::CompressNeighbourFields()
+	{
+		Utils::ParallelForRange(0, particles.Size(), PassGrain(PassLoop::CompressFields),
+			[&](int begin, int end) {
+				CompressNeighbourFields(begin, end);
+			}
+		);
+	}
+
+	template <typename Storage, typename Compute>
+	void FluidSim2D<Storage, Compute>::CompressNeighbourFields(int begin, int end)
+	{
+		for (int i = begin; i < end; ++i) {
+			compressedState.StoreFields(i, glm::vec2(Vec(particles.velocity[i])),
+				static_cast<float>(particles.density[i]), static_cast<float>(particles.pressure[i]));
+		}
+	}
+
+	// 1 / density of every particle, read per neighbour by the approximate force pass
+	template <typename Storage, typename Compute>
+	void FluidSim2D<Storage, Compute>::UpdateInverseDensity()
+	{
+		inverseDensity.resize(particles.Size());
+		Utils::ParallelForRange(0, particles.Size(), PassGrain(PassLoop::InverseDensity),
+			[&](int begin, int end) {
+				UpdateInverseDensity(begin, end);
+			}
+		);
+	}
+
+	template <typename Storage, typename Compute>
+	void FluidSim2D<Storage, Compute>::UpdateInverseDensity(int begin, int end)
+	{
+		for (int i = begin; i < end; ++i) {
+			inverseDensity[i] = Compute(1) / Compute(particles.density[i]);
+		}
+	}
+
+	static inline double Norm2(double x) { return x * x; }
+	static inline double Norm2(const glm::dvec2& v) { return glm::dot(v, v); }
+
+	template <typename T>
+	static inline double Widen(const T& x) { return static_cast<double>(x); }
+	template <typename T>
+	static inline glm::dvec2 Widen(const glm::vec<2, T>& v) { return glm::dvec2(v); }
 
-							const Particle& neighbour = particles[neighbour_idx];
-							glm::vec2 diff = particle.position - neighbour.position;
-							float dist2 = glm::dot(diff, diff);
+	// Max and RMS of |approximate - exact| over all particles, relative to the RMS of |exact|
+	template <typename Array>
+	static void ComparePass(const Array& exact, const Array& approximate, PassError& error)
+	{
+		double sum_exact2 = 0.0;
+		double sum_error2 = 0.0;
+		double max_error2 = 0.0;
+		for (size_t i = 0; i < exact.size(); ++i) {
+			const double error2 = Norm2(Widen(approximate[i]) - Widen(exact[i]));
+			sum_exact2 += Norm2(Widen(exact[i]));
+			sum_error2 += error2;
+			max_error2 = std::max(max_error2, error2);
+		}
+		const double scale = sum_exact2 > 0.0 ? std::sqrt(exact.size() / sum_exact2) : 0.0;
+		error.max_error = std::sqrt(max_error2) * scale;
+		error.rms_error = std::sqrt(sum_error2 / std::max<size_t>(exact.size(), 1)) * scale;
+	}
+
+	template <typename Func>
+	static double TimePass(Func&& pass)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		pass();
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Steps the stage timings are summed over before the UI shows them
+	static constexpr int TIMING_WINDOW = 60;
+	// Steps a backend comparison runs before timing, enough for every grain tuner to settle
+	static constexpr int COMPARE_WARMUP_STEPS = 30;
+
+	/*
+		Accuracy harness for fast math. Runs the per-particle density and force passes
+		exactly and approximately on the current state and compares the results. The
+		approximate force pass is given the exact densities and pressures, so each row is
+		the error of that pass alone; with the pair cache on, its distances come from the
+		approximate density pass, as they would in a step. The passes only overwrite
+		values the next step recomputes.
+	*/
+	template <typename Storage, typename Compute>
+	ApproximationReport FluidSim2D<Storage, Compute>::MeasureApproximationError()
+	{
+		// The force passes are compared by the forces they store, so never integrate in them
+		Params params = UpdateParams();
+		params.fused = false;
+		const KernelPasses& exact = GetKernelPasses(params, false);
+		const KernelPasses& approximate = GetKernelPasses(params, true);
+		const int compressed = params.settings.compress_neighbour_state;
+		const int viscosity = HasViscosity(params);
+		ApproximationReport report;
+
+		if (compressed)
+			CompressNeighbourPositions();
+
+		report.density.exact_ms = TimePass([&]() { exact.density_shg[compressed](*this, params); });
+		const AlignedVector<Storage> exact_density = particles.density;
+		report.density.approximate_ms = TimePass([&]() { approximate.density_shg[compressed](*this, params); });
+		ComparePass(exact_density, particles.density, report.density);
+
+		// Exact inputs for both force passes
+		exact.density_shg[compressed](*this, params);
+		UpdateParticlePressure(params);
+		if (compressed)
+			CompressNeighbourFields();
+		UpdateInverseDensity();
+
+		const double exact_ms = TimePass([&]() { exact.forces_shg[viscosity][compressed](*this, params); });
+		const AlignedVector<Vec> exact_pressure = particles.F_pressure;
+		const AlignedVector<Vec> exact_viscosity = particles.F_viscosity;
+
+		approximate.density_shg[compressed](*this, params);
+		particles.density = exact_density;
+		const double approximate_ms = TimePass([&]() { approximate.forces_shg[viscosity][compressed](*this, params); });
+
+		ComparePass(exact_pressure, particles.F_pressure, report.pressure_force);
+		report.pressure_force.exact_ms = report.viscosity_force.exact_ms = exact_ms;
+		report.pressure_force.approximate_ms = report.viscosity_force.approximate_ms = approximate_ms;
+		if (viscosity)
+			ComparePass(exact_viscosity, particles.F_viscosity, report.viscosity_force);
+		return report;
+	}
+
+	/*
+		Newton's third law variant of ComputeForcesSHG. Every pair is visited once from its
+		lower index and the shared kernel terms are applied to both particles. Each side
+		still divides by the other particle's density, so the result matches the
+		asymmetric pass up to summation order.
+
+		Writes to the higher index can land in any other chunk, so each chunk accumulates
+		into its own buffer and the buffers are summed in chunk order afterwards. No
+		atomics are needed, and the result is the same on every run for a given chunk count.
+	*/
+	template <typename Storage, typename Compute>
+	template <typename Kernel, unsigned Terms>
+	void FluidSim2D<Storage, Compute>::ComputeForcesSymmetric(const Params& params, const Kernel& kernel)
+	{
+		constexpr bool viscosity = (Terms & TERM_VISCOSITY) != 0;
+		const Compute R2 = params.R2;
+		const Compute mass = params.mass;
+		const int count = particles.Size();
+
+		const int max_chunks = Utils::GetParallelThreadCount();
+		const int chunk_count = std::clamp(count / 256, 1, max_chunks);
+		const int chunk_size = (count + chunk_count - 1) / chunk_count;
+
+		const size_t buffer_size = static_cast<size_t>(chunk_count) * count;
+		chunkPressure.resize(buffer_size);
+		Utils::ParallelFill(chunkPressure.begin(), chunkPressure.end(), Vec(0.0f));
+		if constexpr (viscosity) {
+			chunkViscosity.resize(buffer_size);
+			Utils::ParallelFill(chunkViscosity.begin(), chunkViscosity.end(), Vec(0.0f));
+		}
+
+		Utils::ParallelFor(0, chunk_count, 1,
+			[&](int chunk) {
+				Vec* f_pressure = &chunkPressure[static_cast<size_t>(chunk) * count];
+				Vec* f_viscosity = viscosity ? &chunkViscosity[static_cast<size_t>(chunk) * count] : nullptr;
+
+				const int end = std::min(count, (chunk + 1) * chunk_size);
+				for (int i = chunk * chunk_size; i < end; ++i) {
+					const Vec position = particles.position[i];
+					const Vec velocity = particles.velocity[i];
+					const Compute pressure = particles.pressure[i];
+					const Compute density = particles.density[i];
+
+					auto interact = [&](int neighbour_idx, Compute eucalidian_dist, const Vec& direction) {
+						Vec kernel_gradient = kernel.Gradient(eucalidian_dist) * direction;
+
+						const Compute neighbour_density = particles.density[neighbour_idx];
+						const Compute shared_pressure = -mass * 0.5f * (pressure + particles.pressure[neighbour_idx]);
+						f_pressure[i] += (shared_pressure / neighbour_density) * kernel_gradient;
+						f_pressure[neighbour_idx] -= (shared_pressure / density) * kernel_gradient;
+
+						if constexpr (viscosity) {
+							const Vec v_rel = Vec(particles.velocity[neighbour_idx]) - velocity;
+							f_viscosity[i] += mass * (v_rel / neighbour_density) * kernel.Laplacian(eucalidian_dist);
+							f_viscosity[neighbour_idx] -= mass * (v_rel / density) * kernel.Laplacian(eucalidian_dist);
+						}
+					};
+
+					if (pairCache.valid) {
+						for (int k = pairCache.Begin(i); k < pairCache.End(i); ++k) {
+							const PairEntry<Compute>& pair = pairCache.entries[k];
+							if (!pairCache.half && pair.neighbour < i) continue;
+							interact(pair.neighbour, pair.r, (position - Vec(particles.position[pair.neighbour])) * pair.inv_r);
+						}
+					} else {
+						ForEachNeighbourCandidate(i, position, [&](int neighbour_idx) {
+							if (neighbour_idx <= i) return;
+
+							Vec diff = position - Vec(particles.position[neighbour_idx]);
+							Compute dist2 = glm::dot(diff, diff);
 
 							if (dist2 < R2 && dist2 > 1e-6f) {
-								// Calculate Spiky gradiant and Laplacian of Viscosity
-								float eucalidian_dist = sqrt(dist2);
-								float term = PhysicsConstants::SMOOTHING_RADIUS - eucalidian_dist;
-								glm::vec2 direction = diff / eucalidian_dist;
+								Compute eucalidian_dist = sqrt(dist2);
+								interact(neighbour_idx, eucalidian_dist, diff / eucalidian_dist);
+							}
+						});
+					}
+				}
+			}
+		);
+
+		// Reduce the chunk buffers in a fixed order
+		Utils::ParallelFor(0, count, PassGrain(PassLoop::ForcesSymmetric),
+			[&](int i) {
+				Vec f_pressure(0.0f);
+				Vec f_viscosity(0.0f);
+				for (int chunk = 0; chunk < chunk_count; ++chunk) {
+					f_pressure += chunkPressure[static_cast<size_t>(chunk) * count + i];
+					if constexpr (viscosity)
+						f_viscosity += chunkViscosity[static_cast<size_t>(chunk) * count + i];
+				}
+				particles.F_pressure[i] = f_pressure;
+				if constexpr (viscosity)
+					particles.F_viscosity[i] = params.viscosity * f_viscosity;
+			}
+		);
+	}
+
+	/*
+		Splits every grid cell into clusters of CLUSTER_SIZE particles and pairs up the
+		clusters of neighbouring cells. Must follow UpdateSpatialHashGrid. The cluster
+		kernels are float only, so the other instantiations never select them.
+	*/
+	template <typename Storage, typename Compute>
+	void FluidSim2D<Storage, Compute>::BuildClusterPairs(const Params& params)
+	{
+		if constexpr (NATIVE_FLOAT) {
+			clusterList.SetClusterSize(params.settings.cluster_size);
+			clusterList.BuildClusters(grid, particles.position);
+			clusterList.BuildPairs(params.settings.smoothing_radius,
+				[&](const glm::vec2& position, auto&& func) { ForEachCandidateRange(position, 1, func); });
+		}
+	}
+
+	template <typename Storage, typename Compute>
+	void FluidSim2D<Storage, Compute>::UpdateParticleDensityClusters(const Params& params)
+	{
+		if constexpr (NATIVE_FLOAT)
+			clusterList.ComputeDensity(params.cluster_params, particles.density);
+	}
+
+	template <typename Storage, typename Compute>
+	void FluidSim2D<Storage, Compute>::ComputeForcesClusters(const Params& params)
+	{
+		if constexpr (NATIVE_FLOAT)
+			clusterList.ComputeForces(params.cluster_params, particles, particles.F_pressure, particles.F_viscosity);
+	}
+
+	/*
+		Contiguous Structure of Arrays copy of the particles in one cell's 3x3
+		neighbourhood. Each worker thread keeps its own, so after the first few cells no
+		pass allocates. The tile is padded for the vector kernels with entries far outside
+		the domain, which no kernel ever counts as a neighbour. Fields are held in the
+		compute type, so half precision state is widened once per cell.
+	*/
+	template <typename T>
+	struct NeighbourTile {
+		AlignedVector<int> index;
+		AlignedVector<T> x, y;
+		AlignedVector<T> vx, vy;
+		AlignedVector<T> density, pressure;
+		int count = 0;
+
+		void Clear()
+		{
+			index.clear();
+			x.clear();
+			y.clear();
+			vx.clear();
+			vy.clear();
+			density.clear();
+			pressure.clear();
+		}
+
+		// Records the real particle count, then pads up to a multiple of SIMD_TILE_PADDING
+		void Pad()
+		{
+			count = static_cast<int>(index.size());
+			const bool has_fields = !density.empty();
+			while (index.size() % SIMD_TILE_PADDING != 0) {
+				index.push_back(-1);
+				x.push_back(T(1e10f));
+				y.push_back(T(1e10f));
+				if (has_fields) {
+					vx.push_back(T(0));
+					vy.push_back(T(0));
+					density.push_back(T(1));
+					pressure.push_back(T(0));
+				}
+			}
+		}
+
+		// Only for float tiles, the vector kernels read float
+		TileView View() const
+		{
+			return TileView{ index.data(), x.data(), y.data(), vx.data(), vy.data(),
+				density.data(), pressure.data(), static_cast<int>(index.size()) };
+		}
+	};
+
+	// Lists the non-empty cells of the current grid together with their coordinates
+	template <typename Storage, typename Compute>
+	void FluidSim2D<Storage, Compute>::BuildOccupancyList()
+	{
+		activeCells.clear();
+		const std::vector<int>& sorted = grid.SortedIndices();
+		for (int key = 0; key < grid.GetCellCount(); ++key) {
+			if (grid.CellCount(key) == 0) continue;
+
+			const glm::ivec2 coord = gridDense
+				? gridLayout.CellCoord(key)
+				: GetCellCoord(particles.position[sorted[grid.CellStart(key)]], gridCellSize);
+			activeCells.push_back(ActiveCell{ key, coord });
+		}
+	}
 
-								glm::vec2 spiky_gradient = PhysicsConstants::SpikeyConstant() * term * term * direction;
-								const float viscosity_laplacian = PhysicsConstants::MullerConstant() * term;
+	/*
+		Cell-centric density pass. The stencil of every occupied cell is resolved once and
+		its particles are copied into a tile, then each particle of the cell is summed
+		against that tile. The scalar loop visits candidates in the same order as
+		UpdateParticleDensitySHG without Verlet lists.
+	*/
+	template <typename Storage, typename Compute>
+	template <typename Kernel>
+	void FluidSim2D<Storage, Compute>::UpdateParticleDensityTiled(const Params& params, const Kernel& kernel)
+	{
+		const Compute R2 = params.R2;
+		const Compute mass = params.mass;
+		const std::vector<int>& sorted = grid.SortedIndices();
+		// The vector kernels are written for float Poly6 / Spiky only
+		constexpr bool vector_kernels = NATIVE_FLOAT && std::is_same<Kernel, Poly6SpikyKernel<float>>::value;
+		const SimdKernels* kernels = vector_kernels ? GetSimdKernels(params.simd_level) : nullptr;
+		const KernelConstants& k = params.kernel_constants;
+		const bool fused = params.fused;
+		const Compute rest_density = params.rest_density;
+		const Compute gas_constant = params.gas_constant;
+
+		Utils::ParallelFor(0, static_cast<int>(activeCells.size()), PassGrain(PassLoop::DensityTiles),
+			[&](int active) {
+				const ActiveCell& cell = activeCells[active];
+				thread_local NeighbourTile<Compute> tile;
+				tile.Clear();
+				ForEachCellRange(cell.coord, 1, [&](int begin, int end) {
+					for (int n = begin; n < end; ++n) {
+						const int j = sorted[n];
+						tile.index.push_back(j);
+						tile.x.push_back(particles.position[j].x);
+						tile.y.push_back(particles.position[j].y);
+					}
+				});
+				tile.Pad();
+
+				const int cell_start = grid.CellStart(cell.key);
+				const int cell_end = cell_start + grid.CellCount(cell.key);
+				for (int n = cell_start; n < cell_end; ++n) {
+					const int i = sorted[n];
+					const Vec position = particles.position[i];
+
+					Compute density = 0.0f;
+					bool vectorised = false;
+					if constexpr (vector_kernels) {
+						if (kernels) {
+							density = kernels->Density(k, position, tile.View());
+							vectorised = true;
+						}
+					}
 
-								// Calculate Forces
-								float pressure_avg = 0.5f * (particle.pressure + neighbour.pressure) / neighbour.density;
-								f_pressure += -PhysicsConstants::MASS * pressure_avg * spiky_gradient;
+					if (!vectorised) {
+						for (int t = 0; t < tile.count; ++t) {
+							Vec diff = position - Vec(tile.x[t], tile.y[t]);
+							Compute dist2 = glm::dot(diff, diff);
 
-								glm::vec2 v_rel = neighbour.velocity - particle.velocity;
-								f_viscosity += PhysicsConstants::MASS * (v_rel / neighbour.density) * viscosity_laplacian;
+							if (R2 > dist2) {
+								density += mass * kernel.Density(dist2);
 							}
-							target_grid_idx++;
 						}
 					}
+					particles.density[i] = density;
+					if (fused)
+						particles.pressure[i] = TaitPressure(Compute(particles.density[i]), rest_density, gas_constant);
 				}
+			}
+		);
+	}
 
-				particle.F_pressure = f_pressure;
-				particle.F_viscosity = PhysicsConstants::VISCOCITY_COEFFICIENT * f_viscosity;
+	// Cell-centric counterpart of ComputeForcesSHG, see UpdateParticleDensityTiled
+	template <typename Storage, typename Compute>
+	template <typename Kernel, unsigned Terms>
+	void FluidSim2D<Storage, Compute>::ComputeForcesTiled(const Params& params, const Kernel& kernel)
+	{
+		constexpr bool viscosity = (Terms & TERM_VISCOSITY) != 0;
+		const Compute R2 = params.R2;
+		const Compute mass = params.mass;
+		const std::vector<int>& sorted = grid.SortedIndices();
+		// The vector kernels are written for float Poly6 / Spiky only
+		constexpr bool vector_kernels = NATIVE_FLOAT && std::is_same<Kernel, Poly6SpikyKernel<float>>::value;
+		const SimdKernels* kernels = vector_kernels ? GetSimdKernels(params.simd_level) : nullptr;
+		const KernelConstants& k = params.kernel_constants;
+		const bool fused = params.fused;
+		const bool stage_upload = params.stage_upload;
+		const IntegrateConstants<Compute> integrate = params.integrate;
+
+		Utils::ParallelFor(0, static_cast<int>(activeCells.size()), PassGrain(PassLoop::ForcesTiles),
+			[&](int active) {
+				const ActiveCell& cell = activeCells[active];
+				thread_local NeighbourTile<Compute> tile;
+				tile.Clear();
+				ForEachCellRange(cell.coord, 1, [&](int begin, int end) {
+					for (int n = begin; n < end; ++n) {
+						const int j = sorted[n];
+						tile.index.push_back(j);
+						tile.x.push_back(particles.position[j].x);
+						tile.y.push_back(particles.position[j].y);
+						tile.vx.push_back(particles.velocity[j].x);
+						tile.vy.push_back(particles.velocity[j].y);
+						tile.density.push_back(particles.density[j]);
+						tile.pressure.push_back(particles.pressure[j]);
+					}
+				});
+				tile.Pad();
+
+				const int cell_start = grid.CellStart(cell.key);
+				const int cell_end = cell_start + grid.CellCount(cell.key);
+				for (int n = cell_start; n < cell_end; ++n) {
+					const int i = sorted[n];
+					const Vec position = particles.position[i];
+					const Vec velocity = particles.velocity[i];
+					const Compute pressure = particles.pressure[i];
+
+					if constexpr (vector_kernels) {
+						if (kernels) {
+							const ForceResult forces = kernels->Forces[viscosity](k, i, position, velocity, pressure, tile.View());
+							if (fused) {
+								IntegrateFused(integrate, stage_upload, i, forces.pressure, params.viscosity * forces.viscosity);
+								continue;
+							}
+							particles.F_pressure[i] = forces.pressure;
+							if constexpr (viscosity)
+								particles.F_viscosity[i] = params.viscosity * forces.viscosity;
+							continue;
+						}
+					}
+
+					Vec f_pressure(0.0f);
+					Vec f_viscosity(0.0f);
+					for (int t = 0; t < tile.count; ++t) {
+						if (tile.index[t] == i) continue;
+
+						Vec diff = position - Vec(tile.x[t], tile.y[t]);
+						Compute dist2 = glm::dot(diff, diff);
+
+						if (dist2 < R2 && dist2 > 1e-6f) {
+							// Calculate kernel gradiant and Laplacian of Viscosity
+							Compute eucalidian_dist = sqrt(dist2);
+							Vec direction = diff / eucalidian_dist;
+
+							Vec kernel_gradient = kernel.Gradient(eucalidian_dist) * direction;
+
+							// Calculate Forces
+							Compute pressure_avg = 0.5f * (pressure + tile.pressure[t]) / tile.density[t];
+							f_pressure += -mass * pressure_avg * kernel_gradient;
+
+							if constexpr (viscosity) {
+								Vec v_rel = Vec(tile.vx[t], tile.vy[t]) - velocity;
+								f_viscosity += mass * (v_rel / tile.density[t]) * kernel.Laplacian(eucalidian_dist);
+							}
+						}
+					}
+					if (fused) {
+						IntegrateFused(integrate, stage_upload, i, f_pressure, params.viscosity * f_viscosity);
+						continue;
+					}
+					particles.F_pressure[i] = f_pressure;
+					if constexpr (viscosity)
+						particles.F_viscosity[i] = params.viscosity * f_viscosity;
+				}
 			}
 		);
 	}
 
-	glm::vec2 FluidSim2D::GetMouseWorldPos()
+	/*
+		Every density and force pass instantiated for one kernel policy. One table per
+		KernelShape is built on first use, so switching kernels at runtime is a lookup and
+		each pass still runs with the kernel inlined into its pair loop. The force passes
+		are instantiated with and without the viscosity term, indexed by whether it is on,
+		and the per-particle passes for full and compressed neighbour state.
+
+		The approximate table swaps the per-particle passes for ones using the kernel's
+		TabulatedKernel, which also switches them to FastInverseSqrt and 1 / density.
+
+		Each pass is handed its own copy of the kernel from SimParams. Read through a
+		reference, its coefficients could alias the floats the pass stores and would be
+		reloaded inside the pair loop.
+	*/
+	template <typename Storage, typename Compute>
+	struct FluidSim2D<Storage, Compute>::KernelPasses
+	{
+		using Pass = void (*)(FluidSim2D& sim, const Params& params);
+		using RangePass = void (*)(FluidSim2D& sim, const Params& params, int begin, int end);
+
+		Pass density;
+		Pass density_shg[2];		// Indexed by whether the neighbour state is compressed
+		RangePass density_shg_range[2];
+		Pass density_tiled;
+		Pass forces[2];
+		Pass forces_shg[2][2];
+		RangePass forces_shg_range[2][2];
+		Pass forces_symmetric[2];
+		Pass forces_tiled[2];
+
+		template <typename Kernel, unsigned Terms>
+		static void MakeForcesSHG(KernelPasses& passes)
+		{
+			constexpr int v = (Terms & TERM_VISCOSITY) != 0;
+			passes.forces_shg[v][0] = [](FluidSim2D& sim, const Params& params) { sim.template ComputeForcesSHG<Kernel, Terms, false>(params, Kernel(params.kernels.template Get<Kernel>())); };
+			passes.forces_shg[v][1] = [](FluidSim2D& sim, const Params& params) { sim.template ComputeForcesSHG<Kernel, Terms, true>(params, Kernel(params.kernels.template Get<Kernel>())); };
+			passes.forces_shg_range[v][0] = [](FluidSim2D& sim, const Params& params, int begin, int end) { sim.template ComputeForcesSHG<Kernel, Terms, false>(params, Kernel(params.kernels.template Get<Kernel>()), begin, end); };
+			passes.forces_shg_range[v][1] = [](FluidSim2D& sim, const Params& params, int begin, int end) { sim.template ComputeForcesSHG<Kernel, Terms, true>(params, Kernel(params.kernels.template Get<Kernel>()), begin, end); };
+		}
+
+		template <typename Kernel>
+		static void MakePerParticle(KernelPasses& passes)
+		{
+			passes.density_shg[0] = [](FluidSim2D& sim, const Params& params) { sim.template UpdateParticleDensitySHG<Kernel, false>(params, Kernel(params.kernels.template Get<Kernel>())); };
+			passes.density_shg[1] = [](FluidSim2D& sim, const Params& params) { sim.template UpdateParticleDensitySHG<Kernel, true>(params, Kernel(params.kernels.template Get<Kernel>())); };
+			passes.density_shg_range[0] = [](FluidSim2D& sim, const Params& params, int begin, int end) { sim.template UpdateParticleDensitySHG<Kernel, false>(params, Kernel(params.kernels.template Get<Kernel>()), begin, end); };
+			passes.density_shg_range[1] = [](FluidSim2D& sim, const Params& params, int begin, int end) { sim.template UpdateParticleDensitySHG<Kernel, true>(params, Kernel(params.kernels.template Get<Kernel>()), begin, end); };
+			MakeForcesSHG<Kernel, 0>(passes);
+			MakeForcesSHG<Kernel, TERM_VISCOSITY>(passes);
+		}
+
+		template <typename Kernel, unsigned Terms>
+		static void MakeForces(KernelPasses& passes)
+		{
+			constexpr int v = (Terms & TERM_VISCOSITY) != 0;
+			passes.forces[v] = [](FluidSim2D& sim, const Params& params) { sim.template ComputeForces<Kernel, Terms>(params, Kernel(params.kernels.template Get<Kernel>())); };
+			passes.forces_symmetric[v] = [](FluidSim2D& sim, const Params& params) { sim.template ComputeForcesSymmetric<Kernel, Terms>(params, Kernel(params.kernels.template Get<Kernel>())); };
+			passes.forces_tiled[v] = [](FluidSim2D& sim, const Params& params) { sim.template ComputeForcesTiled<Kernel, Terms>(params, Kernel(params.kernels.template Get<Kernel>())); };
+		}
+
+		template <typename Kernel>
+		static KernelPasses Make()
+		{
+			KernelPasses passes;
+			passes.density = [](FluidSim2D& sim, const Params& params) { sim.UpdateParticleDensity(params, Kernel(params.kernels.template Get<Kernel>())); };
+			passes.density_tiled = [](FluidSim2D& sim, const Params& params) { sim.UpdateParticleDensityTiled(params, Kernel(params.kernels.template Get<Kernel>())); };
+			MakePerParticle<Kernel>(passes);
+			MakeForces<Kernel, 0>(passes);
+			MakeForces<Kernel, TERM_VISCOSITY>(passes);
+			return passes;
+		}
+
+		template <typename Kernel>
+		static KernelPasses MakeApproximate()
+		{
+			KernelPasses passes = Make<Kernel>();
+			MakePerParticle<TabulatedKernel<Kernel>>(passes);
+			return passes;
+		}
+	};
+
+	template <typename Storage, typename Compute>
+	const typename FluidSim2D<Storage, Compute>::KernelPasses& FluidSim2D<Storage, Compute>::GetKernelPasses(const Params& params, bool approximate)
+	{
+		static const KernelPasses table[2][KERNEL_SHAPE_COUNT] = {
+			{
+				KernelPasses::template Make<Poly6SpikyKernel<Compute>>(),
+				KernelPasses::template Make<CubicSplineKernel<Compute>>(),
+				KernelPasses::template Make<WendlandC2Kernel<Compute>>(),
+				KernelPasses::template Make<WendlandC4Kernel<Compute>>(),
+			},
+			{
+				KernelPasses::template MakeApproximate<Poly6SpikyKernel<Compute>>(),
+				KernelPasses::template MakeApproximate<CubicSplineKernel<Compute>>(),
+				KernelPasses::template MakeApproximate<WendlandC2Kernel<Compute>>(),
+				KernelPasses::template MakeApproximate<WendlandC4Kernel<Compute>>(),
+			},
+		};
+		return table[approximate][static_cast<int>(params.settings.kernel_shape)];
+	}
+
+	template <typename Storage, typename Compute>
+	void FluidSim2D<Storage, Compute>::UpdateParticleDensity(const Params& params) { GetKernelPasses(params, params.fast_math).density(*this, params); }
+	template <typename Storage, typename Compute>
+	void FluidSim2D<Storage, Compute>::UpdateParticleDensitySHG(const Params& params) { GetKernelPasses(params, params.fast_math).density_shg[params.settings.compress_neighbour_state](*this, params); }
+	template <typename Storage, typename Compute>
+	void FluidSim2D<Storage, Compute>::UpdateParticleDensityTiled(const Params& params) { GetKernelPasses(params, params.fast_math).density_tiled(*this, params); }
+	template <typename Storage, typename Compute>
+	void FluidSim2D<Storage, Compute>::ComputeForces(const Params& params) { GetKernelPasses(params, params.fast_math).forces[HasViscosity(params)](*this, params); }
+	template <typename Storage, typename Compute>
+	void FluidSim2D<Storage, Compute>::ComputeForcesSHG(const Params& params) { GetKernelPasses(params, params.fast_math).forces_shg[HasViscosity(params)][params.settings.compress_neighbour_state](*this, params); }
+	template <typename Storage, typename Compute>
+	void FluidSim2D<Storage, Compute>::ComputeForcesSymmetric(const Params& params) { GetKernelPasses(params, params.fast_math).forces_symmetric[HasViscosity(params)](*this, params); }
+	template <typename Storage, typename Compute>
+	void FluidSim2D<Storage, Compute>::ComputeForcesTiled(const Params& params) { GetKernelPasses(params, params.fast_math).forces_tiled[HasViscosity(params)](*this, params); }
+
+	/*
+		Terms of the force and integrate passes that currently contribute anything. A
+		term whose constant makes it a no-op (zero viscosity, zero gravity, a damping
+		factor of 1) is left out of the instantiation that runs.
+	*/
+	template <typename Storage, typename Compute>
+	unsigned FluidSim2D<Storage, Compute>::ActiveForceTerms(const SimSettings& settings) const
+	{
+		unsigned terms = 0;
+		if (settings.viscosity != 0.0f)
+			terms |= TERM_VISCOSITY;
+		// Deterministic runs do not follow the mouse
+		if (settings.grabbing && !settings.deterministic && settings.grab_strength != 0.0f)
+			terms |= TERM_EXTERNAL;
+		if (settings.gravity != 0.0f)
+			terms |= TERM_GRAVITY;
+		if (!settings.open_domain) {
+			terms |= TERM_WALLS;
+			if (settings.damping != 1.0f)
+				terms |= TERM_WALL_DAMPING;
+		}
+		return terms;
+	}
+
+	template <typename Storage, typename Compute>
+	int FluidSim2D<Storage, Compute>::HasViscosity(const Params& params)
+	{
+		return (params.force_terms & TERM_VISCOSITY) != 0;
+	}
+
+	template <typename Storage, typename Compute>
+	glm::vec2 FluidSim2D<Storage, Compute>::GetMouseWorldPos()
 	{
 		ImVec2 mouse_pos = ImGui::GetMousePos();
 		ImVec2 win_pos = ImGui::GetWindowPos();
@@ -307,131 +1432,875 @@ namespace simulation {
 		return glm::vec2(width_norm, height_norm);
 	}
 
-	void FluidSim2D::HandleMouseInteraction()
+	template <typename Storage, typename Compute>
+	void FluidSim2D<Storage, Compute>::HandleMouseInteraction(const Params& params)
 	{
 		// Get the particles that are in range of radius
-		glm::vec2 mouse_pos = GetMouseWorldPos();
-		if (ImGui::IsMouseDown(ImGuiMouseButton_Left))
+		const Vec mouse_pos = params.grab_position;
+		if (params.force_terms & TERM_EXTERNAL)
 		{
-			float grab_radius2 = SimulationConstants::GRAB_RADIUS * SimulationConstants::GRAB_RADIUS;
-			int search_range = std::ceil(SimulationConstants::GRAB_RADIUS / PhysicsConstants::SMOOTHING_RADIUS);
-
-			// get the grid coordinate of the click
-			int coord_x = std::floor((mouse_pos.x + 1) / PhysicsConstants::SMOOTHING_RADIUS);
-			int coord_y = std::floor((mouse_pos.y + 1) / PhysicsConstants::SMOOTHING_RADIUS);
-
-			// get surrounding grid coordinates
-			for (int j = -search_range; j <= search_range; ++j) {
-				for (int k = -search_range; k <= search_range; ++k) {
-					int target_x = coord_x + j;
-					int target_y = coord_y + k;
-
-					unsigned int hash_x = target_x * SimulationConstants::PRIME1;
-					unsigned int hash_y = target_y * SimulationConstants::PRIME2;
-
-					unsigned int raw_hash = hash_x ^ hash_y;
-					int target_grid_hash = raw_hash % SimulationConstants::TABLE_SIZE;
-
-					int target_grid_idx = indices[target_grid_hash];
-					if (target_grid_idx == -1) continue;
-					while (target_grid_idx < spatialHash.size() &&
-						spatialHash[target_grid_idx][0] == target_grid_hash) {
-						int neighbour_idx = spatialHash[target_grid_idx][1];
-
-						Particle& neighbour = particles[neighbour_idx];
-						glm::vec2 diff = mouse_pos - neighbour.position;
-						float dist2 = glm::dot(diff, diff);
-
-						if (dist2 < grab_radius2) {
-							float falloff = grab_radius2 - dist2;
-							glm::vec2 force = diff * falloff * SimulationConstants::GRAB_STRENGTH;
-							neighbour.F_other += force;
-						}
-						target_grid_idx++;
-					}
+			const Compute grab_strength = params.settings.grab_strength;
+			const Compute grab_radius2 = params.grab_radius2;
+			auto grab = [&](int neighbour_idx) {
+				Vec diff = mouse_pos - Vec(particles.position[neighbour_idx]);
+				Compute dist2 = glm::dot(diff, diff);
+
+				if (dist2 < grab_radius2) {
+					Compute falloff = grab_radius2 - dist2;
+					Vec force = diff * falloff * grab_strength;
+					particles.cold.F_other[neighbour_idx] += force;
 				}
+			};
+
+			// Without spatial hashing the grid is never rebuilt, so a reorder leaves its
+			// indices pointing at other particles
+			if (!gridSlotsValid) {
+				for (int i = 0; i < particles.Size(); ++i)
+					grab(i);
+				return;
 			}
+
+			// Searches the grid built last step, so its cell size rather than this step's
+			int search_range = std::ceil(params.settings.grab_radius / gridCellSize);
+			const std::vector<int>& sorted = grid.SortedIndices();
+
+			ForEachCandidateRange(mouse_pos, search_range, [&](int begin, int end) {
+				for (int target_grid_idx = begin; target_grid_idx < end; ++target_grid_idx)
+					grab(sorted[target_grid_idx]);
+			});
 		}
 	}
 
-	void FluidSim2D::ResetForces()
+	/*
+		Sums the force terms of particle i and advances its velocity and position into
+		position_out and velocity_out. A term is applied when it is in both Terms and
+		integrate.terms: the templated Integrate passes have them equal so every test is
+		resolved at compile time, the fused force passes use ALL_FORCE_TERMS and test the
+		mask per particle. F_other is cleared once applied, so no separate pass has to
+		reset it before the next step's mouse forces are added.
+	*/
+	template <typename Storage, typename Compute>
+	template <unsigned Terms>
+	inline void FluidSim2D<Storage, Compute>::IntegrateParticle(const IntegrateConstants<Compute>& integrate, int i,
+		const Vec& F_pressure, const Vec& F_viscosity, StorageVec& position_out, StorageVec& velocity_out)
 	{
-		Utils::ParallelForEach(iter_idx.begin(), iter_idx.end(),
-			[&](int i)
-			{
-				Particle& particle = particles[i];
-				particle.F_pressure = glm::vec2(0);
-				particle.F_viscosity = glm::vec2(0);
-				particle.F_other = glm::vec2(0);
-			});
+		const unsigned terms = integrate.terms & Terms;
+
+		Vec F_total = F_pressure;
+		if constexpr ((Terms & TERM_VISCOSITY) != 0)
+			if (terms & TERM_VISCOSITY)
+				F_total += F_viscosity;
+		if constexpr ((Terms & TERM_EXTERNAL) != 0) {
+			if (terms & TERM_EXTERNAL) {
+				F_total += particles.cold.F_other[i];
+				particles.cold.F_other[i] = Vec(0);
+			}
+		}
+		if constexpr ((Terms & TERM_GRAVITY) != 0)
+			if (terms & TERM_GRAVITY)
+				F_total += GravityForce<2>(integrate);
+
+		Vec acceleration = F_total / integrate.mass;
+		particles.cold.acceleration[i] = acceleration;
+
+		Vec position = particles.position[i];
+		Vec velocity = particles.velocity[i];
+		AdvanceParticle<Terms>(integrate, acceleration, position, velocity);
+
+		position_out = position;
+		velocity_out = velocity;
 	}
 
 	/*
-		Update the position in RAM on the CPU side and sends that data to the GPU
+		Sums the enabled force terms and advances velocity and position. Terms is a
+		ForceTerm mask, see ActiveForceTerms.
 	*/
-	void FluidSim2D::OnUpdate() 
+	template <typename Storage, typename Compute>
+	template <unsigned Terms>
+	void FluidSim2D<Storage, Compute>::Integrate(const Params& params)
 	{
-		static int frame_count = 0;
-		ResetForces();
-		HandleMouseInteraction();
+		IntegrateConstants<Compute> integrate = params.integrate;
+		integrate.terms = Terms;
 
-		if (SimulationConstants::USE_SPATIAL_HASHING) {
-			UpdateSpatialHashGrid();
-			UpdateParticleDensitySHG();
-			UpdateParticlePressure();
-			ComputeForcesSHG();
-		} else {
-			UpdateParticleDensity();
-			UpdateParticlePressure();
-			ComputeForces();
-		}
-
-		Utils::ParallelForEach(particles.begin(), particles.end(), 
-			[&](Particle& particle) {
-				glm::vec2 F_total = particle.F_pressure +
-									particle.F_viscosity +
-									particle.F_other +
-									PhysicsConstants::MASS * glm::vec2(0.0f, -PhysicsConstants::GRAVITY);
-
-				particle.acceleration = F_total / PhysicsConstants::MASS;
-				particle.velocity += particle.acceleration * GlobalConstants::DT;
-				float speed2 = glm::dot(particle.velocity, particle.velocity);
-				if (speed2 > SimulationConstants::MaxSpeed() * SimulationConstants::MaxSpeed()) {
-					particle.velocity = glm::normalize(particle.velocity) * SimulationConstants::MaxSpeed();
-				}
-				particle.position += particle.velocity * GlobalConstants::DT;
+		Utils::ParallelFor(0, particles.Size(), PassGrain(PassLoop::Integrate),
+			[&](int i) {
+				IntegrateParticle<Terms>(integrate, i, particles.F_pressure[i], particles.F_viscosity[i],
+					particles.position[i], particles.velocity[i]);
+			}
+		);
+	}
 
-				// Boundary conditions
-				if (particle.position.x < -1.0) {
-					particle.position.x = -1.0;
-					particle.velocity.x *= SimulationConstants::DAMPENING;
+	/*
+		Integrates particle i from inside a fused force pass. Its neighbours may still
+		be reading its current position and velocity, so the result goes to the back
+		buffers, which OnUpdate swaps in once the pass is done. With stage_upload the
+		float copy for the GPU is written here too, rather than in another sweep.
+	*/
+	template <typename Storage, typename Compute>
+	inline void FluidSim2D<Storage, Compute>::IntegrateFused(const IntegrateConstants<Compute>& integrate, bool stage_upload,
+		int i, const Vec& F_pressure, const Vec& F_viscosity)
+	{
+		StorageVec& position = particles.next_position[i];
+		StorageVec& velocity = particles.next_velocity[i];
+		IntegrateParticle<ALL_FORCE_TERMS>(integrate, i, F_pressure, F_viscosity, position, velocity);
+
+		if (stage_upload) {
+			const int id = particles.id[i];
+			uploadPosition[id] = glm::vec2(Vec(position));
+			uploadVelocity[id] = glm::vec2(Vec(velocity));
+		}
+	}
+
+	/*
+		For every task block, the blocks holding a neighbour candidate of any of its
+		particles: those present in the 3x3 cells around each particle's cell when the
+		grid was built. With a Verlet list that is the grid the list was built from, so
+		it covers the list as well. The sparse grid has no neighbouring keys to walk, so
+		there every block depends on all of them.
+	*/
+	template <typename Storage, typename Compute>
+	void FluidSim2D<Storage, Compute>::UpdateBlockNeighbours(int blockSize, int blockCount)
+	{
+		const uint64_t all_blocks = blockCount == 64 ? ~0ull : (1ull << blockCount) - 1;
+		blockNeighbours.assign(blockCount, all_blocks);
+		if (!gridDense)
+			return;
+
+		const std::vector<int>& sorted = grid.SortedIndices();
+		cellBlocks.resize(gridLayout.CellCount());
+		Utils::ParallelFor(0, gridLayout.CellCount(), Utils::DEFAULT_GRAIN,
+			[&](int cell) {
+				uint64_t blocks = 0;
+				const int start = grid.CellStart(cell);
+				for (int k = start; k < start + grid.CellCount(cell); ++k) {
+					blocks |= 1ull << (sorted[k] / blockSize);
 				}
+				cellBlocks[cell] = blocks;
+			}
+		);
 
-				if (particle.position.x > 1.0) {
-					particle.position.x = 1.0;
-					particle.velocity.x *= SimulationConstants::DAMPENING;
+		const int count = particles.Size();
+		Utils::ParallelFor(0, blockCount, 1,
+			[&](int block) {
+				uint64_t blocks = 0;
+				const int end = std::min(count, (block + 1) * blockSize);
+				for (int i = block * blockSize; i < end; ++i) {
+					gridLayout.ForEachRow(gridLayout.CellCoord(cellKeys[i]), 1, [&](int first_cell, int last_cell) {
+						for (int cell = first_cell; cell <= last_cell; ++cell)
+							blocks |= cellBlocks[cell];
+					});
 				}
+				blockNeighbours[block] = blocks;
+			}
+		);
+	}
+
+	/*
+		The per-particle step from the density pass to the upload, as a graph of tasks
+		over blocks of TASK_BLOCK_SIZE particles in storage order:
+
+			density[b] -> pressure[b] -> forces[b] -> integrate[b] -> upload[b]
+
+		Pressure only reads a particle's own density, so pressure[b] waits for density[b]
+		alone, while forces[b] waits for pressure[n] of every block n in
+		blockNeighbours[b]. Integration writes the back buffers, so it does not wait for
+		other blocks still reading the current state, and the upload of each block is
+		issued from the GL thread while the remaining blocks integrate. Points are drawn
+		without reference to their index, so the buffer is filled in storage order here;
+		only which of two overlapping points ends up on top can differ.
+
+		The grid, Verlet list and compressed positions are built beforehand by whole
+		array passes: binning needs every key before any cell is complete.
+	*/
+	template <typename Storage, typename Compute>
+	void FluidSim2D<Storage, Compute>::RunStepGraph(const Params& params)
+	{
+		enum GraphStage { Density, Pressure, Forces, IntegrateBlock, Upload, GRAPH_STAGE_COUNT };
+
+		const int count = particles.Size();
+		// Masks hold one bit per block
+		const int block_size = std::max(SimulationConstants::TASK_BLOCK_SIZE, (count + 63) / 64);
+		const int block_count = (count + block_size - 1) / block_size;
+		const bool compressed = params.settings.compress_neighbour_state;
+		const bool upload = m_VertexBuffer != nullptr;
+
+		ReservePairCache(params);
+		if (params.fast_math)
+			inverseDensity.resize(count);
+		UpdateBlockNeighbours(block_size, block_count);
+
+		// Task stage * block_count + block, so a task's block and stage follow from its index
+		stepGraph.Clear();
+		stepGraphBlocks = block_count;
+		const int stage_count = upload ? GRAPH_STAGE_COUNT : Upload;
+		for (int stage = 0; stage < stage_count; ++stage) {
+			for (int block = 0; block < block_count; ++block)
+				stepGraph.Add(stage == Upload);
+		}
+		auto task = [&](int stage, int block) { return stage * block_count + block; };
+		for (int block = 0; block < block_count; ++block) {
+			stepGraph.Depend(task(Pressure, block), task(Density, block));
+			for (int other = 0; other < block_count; ++other) {
+				if (blockNeighbours[block] & (1ull << other))
+					stepGraph.Depend(task(Forces, block), task(Pressure, other));
+			}
+			stepGraph.Depend(task(IntegrateBlock, block), task(Forces, block));
+			if (upload)
+				stepGraph.Depend(task(Upload, block), task(IntegrateBlock, block));
+		}
+
+		const KernelPasses& passes = GetKernelPasses(params, params.fast_math);
+		const typename KernelPasses::RangePass density = passes.density_shg_range[compressed];
+		const typename KernelPasses::RangePass forces = passes.forces_shg_range[HasViscosity(params)][compressed];
+		const IntegrateConstants<Compute> integrate = params.integrate;
+		constexpr bool float_storage = std::is_same<Storage, float>::value;
+		if (upload) {
+			if constexpr (!float_storage) {
+				uploadPosition.resize(count);
+				uploadVelocity.resize(count);
+			}
+			m_VertexBuffer->Bind();
+		}
 
-				if (particle.position.y < -1.0) {
-					particle.position.y = -1.0;
-					particle.velocity.y *= SimulationConstants::DAMPENING;
+		auto run = [&](int t) {
+			const int block = t % block_count;
+			const int begin = block * block_size;
+			const int end = std::min(count, begin + block_size);
+			switch (t / block_count) {
+			case Density:
+				density(*this, params, begin, end);
+				break;
+			case Pressure:
+				UpdateParticlePressure(params, begin, end);
+				if (compressed)
+					CompressNeighbourFields(begin, end);
+				if (params.fast_math)
+					UpdateInverseDensity(begin, end);
+				break;
+			case Forces:
+				forces(*this, params, begin, end);
+				break;
+			case IntegrateBlock:
+				for (int i = begin; i < end; ++i) {
+					IntegrateFused(integrate, false, i, particles.F_pressure[i], particles.F_viscosity[i]);
+					if constexpr (!float_storage) {
+						if (upload) {
+							uploadPosition[i] = glm::vec2(Vec(particles.next_position[i]));
+							uploadVelocity[i] = glm::vec2(Vec(particles.next_velocity[i]));
+						}
+					}
 				}
+				break;
+			case Upload: {
+				const glm::vec2* position;
+				const glm::vec2* velocity;
+				if constexpr (float_storage) {
+					position = particles.next_position.data();
+					velocity = particles.next_velocity.data();
+				} else {
+					position = uploadPosition.data();
+					velocity = uploadVelocity.data();
+				}
+				const size_t offset = begin * sizeof(glm::vec2);
+				const size_t size = (end - begin) * sizeof(glm::vec2);
+				GLCall(glBufferSubData(GL_ARRAY_BUFFER, offset, size, position + begin));
+				GLCall(glBufferSubData(GL_ARRAY_BUFFER, count * sizeof(glm::vec2) + offset, size, velocity + begin));
+				break;
+			}
+			}
+		};
+		stepGraph.Run(run);
+	}
+
+	template <typename Storage, typename Compute>
+	struct FluidSim2D<Storage, Compute>::IntegrateFactory {
+		template <unsigned Terms>
+		static constexpr IntegratePass Get() { return [](FluidSim2D& sim, const Params& params) { sim.template Integrate<Terms>(params); }; }
+	};
+
+	template <typename Storage, typename Compute>
+	void FluidSim2D<Storage, Compute>::Integrate(const Params& params)
+	{
+		const unsigned terms = params.force_terms;
+
+		if constexpr (NATIVE_FLOAT) {
+			if (const SimdKernels* kernels = GetSimdKernels(params.simd_level)) {
+				IntegrateArrays arrays;
+				arrays.position = particles.position.data();
+				arrays.velocity = particles.velocity.data();
+				arrays.acceleration = particles.cold.acceleration.data();
+				arrays.F_pressure = particles.F_pressure.data();
+				arrays.F_viscosity = particles.F_viscosity.data();
+				arrays.F_other = particles.cold.F_other.data();
+
+				const int count = particles.Size();
+				const int block_count = (count + SimulationConstants::SIMD_BLOCK_SIZE - 1) / SimulationConstants::SIMD_BLOCK_SIZE;
+				Utils::ParallelFor(0, block_count, 1,
+					[&](int block) {
+						const int begin = block * SimulationConstants::SIMD_BLOCK_SIZE;
+						const int end = std::min(count, begin + SimulationConstants::SIMD_BLOCK_SIZE);
+						kernels->Integrate[terms](params.integrate_params, arrays, begin, end);
+					}
+				);
+				return;
+			}
+		}
+
+		static constexpr std::array<IntegratePass, FORCE_TERM_COMBINATIONS> table = MakeForceTermTable<IntegrateFactory>();
+		table[terms](*this, params);
+	}
+
+	/*
+		Copies the settings the UI may have changed since the last step into the step's
+		SimParams. Only a step whose settings differ from the previous one pays for
+		deriving the rest; the mouse position is the one input read every step.
+	*/
+	template <typename Storage, typename Compute>
+	const typename FluidSim2D<Storage, Compute>::Params& FluidSim2D<Storage, Compute>::UpdateParams()
+	{
+		SimSettings settings;
+		settings.smoothing_radius = PhysicsConstants::SMOOTHING_RADIUS;
+		settings.mass = PhysicsConstants::MASS;
+		settings.rest_density = PhysicsConstants::REST_DENSITY;
+		settings.viscosity = PhysicsConstants::VISCOCITY_COEFFICIENT;
+		settings.gas_constant = PhysicsConstants::GASS_CONSTANT;
+		settings.gravity = PhysicsConstants::GRAVITY;
+		settings.kernel_shape = PhysicsConstants::KERNEL_SHAPE;
+
+		settings.damping = SimulationConstants::DAMPENING;
+		settings.grab_radius = SimulationConstants::GRAB_RADIUS;
+		settings.grab_strength = SimulationConstants::GRAB_STRENGTH;
+		// Off screen solvers (benchmarks) have no ImGui context to ask
+		settings.grabbing = m_VertexBuffer && ImGui::IsMouseDown(ImGuiMouseButton_Left);
+
+		settings.spatial_hashing = SimulationConstants::USE_SPATIAL_HASHING;
+		settings.dense_grid = SimulationConstants::USE_DENSE_GRID;
+		settings.open_domain = SimulationConstants::OPEN_DOMAIN;
+		settings.reorder_curve = SimulationConstants::REORDER_CURVE;
+		settings.reorder_interval = SimulationConstants::REORDER_INTERVAL;
+		settings.verlet_lists = SimulationConstants::USE_VERLET_LISTS;
+		settings.verlet_skin = SimulationConstants::VERLET_SKIN;
+		settings.pair_cache = SimulationConstants::USE_PAIR_CACHE;
+		settings.symmetric_forces = SimulationConstants::USE_SYMMETRIC_FORCES;
+		settings.cluster_pairs = SimulationConstants::USE_CLUSTER_PAIRS;
+		settings.cluster_size = SimulationConstants::CLUSTER_SIZE;
+		settings.cell_tiles = SimulationConstants::USE_CELL_TILES;
+		settings.compress_neighbour_state = SimulationConstants::COMPRESS_NEIGHBOUR_STATE;
+		settings.deterministic = SimulationConstants::DETERMINISTIC;
+		settings.fast_math = SimulationConstants::FAST_MATH;
+		settings.collect_grid_stats = SimulationConstants::COLLECT_GRID_STATS;
+		settings.fused_passes = SimulationConstants::FUSED_PASSES;
+		settings.task_graph = SimulationConstants::USE_TASK_GRAPH;
+		settings.load_balance = SimulationConstants::LOAD_BALANCE;
+		settings.simd_level = simdLevel;
+		settings.gpu_upload = m_VertexBuffer != nullptr;
+		settings.parallel_backend = SimulationConstants::PARALLEL_BACKEND;
+		settings.worker_threads = SimulationConstants::WORKER_THREADS;
+		settings.pin_workers = SimulationConstants::PIN_WORKERS;
+		settings.numa_aware = SimulationConstants::NUMA_AWARE;
+		settings.grain_size = SimulationConstants::GRAIN_SIZE;
+		settings.auto_grain = SimulationConstants::AUTO_GRAIN;
+
+		if (!stepParamsValid || settings != stepParams.settings)
+			DeriveParams(settings);
+
+		if (stepParams.force_terms & TERM_EXTERNAL)
+			stepParams.grab_position = GetMouseWorldPos();
+		return stepParams;
+	}
+
+	template <typename Storage, typename Compute>
+	void FluidSim2D<Storage, Compute>::DeriveParams(const SimSettings& settings)
+	{
+		Params& params = stepParams;
+
+		// Building the tabulated kernels samples every shape, so only redo it for a new h
+		if (!stepParamsValid || settings.smoothing_radius != params.settings.smoothing_radius)
+			params.kernels = KernelSet<Compute>(Compute(settings.smoothing_radius));
+		params.settings = settings;
+		stepParamsValid = true;
+
+		const float h = settings.smoothing_radius;
+		const float max_speed = h * SimulationConstants::SAFETY_FACTOR / GlobalConstants::DT;
+		params.h = h;
+		params.R2 = Compute(h) * Compute(h);
+		params.mass = settings.mass;
+		params.rest_density = settings.rest_density;
+		params.gas_constant = settings.gas_constant;
+		params.viscosity = settings.viscosity;
+		params.gravity = settings.gravity;
+		params.dt = GlobalConstants::DT;
+		params.max_speed = max_speed;
+		params.max_speed2 = params.max_speed * params.max_speed;
+
+		KernelConstants& k = params.kernel_constants;
+		k.h = h;
+		k.R2 = h * h;
+		k.mass = settings.mass;
+		k.poly6 = 4.0f / (PhysicsConstants::PI * calculate_r8(h));
+		k.spiky = -45.0f / (PhysicsConstants::PI * calculate_r6(h));
+		k.muller = 45.0f / (PhysicsConstants::PI * calculate_r6(h));
+
+		ClusterPairList::Params& cluster = params.cluster_params;
+		cluster.h = k.h;
+		cluster.R2 = k.R2;
+		cluster.mass = k.mass;
+		cluster.poly6 = k.poly6;
+		cluster.spiky = k.spiky;
+		cluster.muller = k.muller;
+		cluster.viscosity = settings.viscosity;
+
+		IntegrateParams& integrate = params.integrate_params;
+		integrate.mass = settings.mass;
+		integrate.gravity = settings.gravity;
+		integrate.dt = GlobalConstants::DT;
+		integrate.max_speed = max_speed;
+		integrate.damping = settings.damping;
+		integrate.domain_min = SimulationConstants::DOMAIN_MIN;
+		integrate.domain_max = SimulationConstants::DOMAIN_MAX;
+
+		const Traversal previous_traversal = params.traversal;
+		params.traversal = SelectTraversal(settings);
+		params.simd_level = ActiveSimdLevel(settings);
+		params.force_terms = ActiveForceTerms(settings);
+		params.symmetric_forces = UseSymmetricForces(settings);
+		params.fast_math = UseFastMath(settings);
+
+		// Another traversal has other pass costs, so the grains are tuned again
+		if (params.traversal != previous_traversal) {
+			for (Utils::GrainTuner& tuner : grainTuners)
+				tuner.Restart();
+		}
+		ApplyParallelSettings();
+
+		IntegrateConstants<Compute>& constants = params.integrate;
+		constants.mass = params.mass;
+		constants.gravity = params.gravity;
+		constants.dt = params.dt;
+		constants.max_speed = params.max_speed;
+		constants.max_speed2 = params.max_speed2;
+		constants.damping = settings.damping;
+		constants.domain_min = SimulationConstants::DOMAIN_MIN;
+		constants.domain_max = SimulationConstants::DOMAIN_MAX;
+		constants.terms = params.force_terms;
+
+		// The task graph has its own pressure and integrate tasks per block
+		params.task_graph = settings.task_graph && params.traversal == Traversal::PerParticle;
+		// Placement follows the slices the pool seeds its threads with
+		params.numa = settings.numa_aware && Utils::GetParallelBackend() == Utils::ParallelBackend::ThreadPool;
+		// The task graph already works in blocks of its own
+		params.load_balance = params.traversal == Traversal::PerParticle && !params.task_graph ? settings.load_balance : LoadBalance::Off;
+
+		// Integrating inside the force pass needs every particle's forces to be final
+		// when its own loop ends, which the symmetric and cluster passes do not give
+		params.fused = settings.fused_passes && !params.task_graph && (params.traversal == Traversal::CellTiles ||
+			(params.traversal == Traversal::PerParticle && !params.symmetric_forces));
+		// Staging is only worth it when the upload would otherwise need its own copy
+		params.stage_upload = settings.gpu_upload && (settings.reorder_interval > 0 || !std::is_same<Storage, float>::value);
+
+		// An open domain has no bounds to lay a dense grid over
+		params.grid_dense = settings.dense_grid && !settings.open_domain;
+
+		// Verlet lists search out to h + skin, so the cells must be that wide. Cluster
+		// pairs and cell tiles are rebuilt every step and use plain h wide cells.
+		params.verlet_skin = settings.verlet_skin * h;
+		params.verlet_radius = h + params.verlet_skin;
+		params.grid_cell_size = h;
+		if (settings.verlet_lists && params.traversal == Traversal::PerParticle)
+			params.grid_cell_size += params.verlet_skin;
+
+		// The dense grid is resized whenever the smoothing radius changes
+		const float domain_size = SimulationConstants::DOMAIN_MAX - SimulationConstants::DOMAIN_MIN;
+		params.grid_width = static_cast<int>(domain_size / params.grid_cell_size) + 1;
+
+		params.grab_radius2 = settings.grab_radius * settings.grab_radius;
+	}
+
+	/*
+		Picks the density and force passes for this step. Compressed neighbour state, fast
+		math and the task graph only exist in the per-particle passes, so they take
+		precedence over the tiled traversals, and cluster tiles only implement float
+		Poly6 / Spiky. Deterministic mode always uses the per-particle passes, the
+		reference the others are checked against.
+	*/
+	template <typename Storage, typename Compute>
+	Traversal FluidSim2D<Storage, Compute>::SelectTraversal(const SimSettings& settings) const
+	{
+		if (!settings.spatial_hashing)
+			return Traversal::AllPairs;
+		if (settings.compress_neighbour_state || settings.deterministic || settings.fast_math || settings.task_graph)
+			return Traversal::PerParticle;
+		if (NATIVE_FLOAT && settings.cluster_pairs && settings.kernel_shape == KernelShape::Poly6Spiky)
+			return Traversal::ClusterPairs;
+		if (settings.cell_tiles)
+			return Traversal::CellTiles;
+		return Traversal::PerParticle;
+	}
+
+	/*
+		The symmetric pass only reads the full neighbour state with exact math, and its
+		chunk count (so its summation order) follows the thread count, which rules it out
+		in deterministic mode.
+	*/
+	template <typename Storage, typename Compute>
+	bool FluidSim2D<Storage, Compute>::UseSymmetricForces(const SimSettings& settings) const
+	{
+		return settings.symmetric_forces && !settings.compress_neighbour_state && !settings.deterministic && !settings.fast_math &&
+			!settings.task_graph;
+	}
+
+	// The FastInverseSqrt estimate differs between x86 and wasm
+	template <typename Storage, typename Compute>
+	bool FluidSim2D<Storage, Compute>::UseFastMath(const SimSettings& settings) const
+	{
+		return settings.fast_math && !settings.deterministic;
+	}
+
+	/*
+		The vector kernels sum in a different order from the scalar loops, and how they
+		round depends on the instruction set, so deterministic mode stays scalar.
+	*/
+	template <typename Storage, typename Compute>
+	SimdLevel FluidSim2D<Storage, Compute>::ActiveSimdLevel(const SimSettings& settings) const
+	{
+		return settings.deterministic ? SimdLevel::Scalar : settings.simd_level;
+	}
+
+	/*
+		Restarts the thread pool if the step's settings size or pin it differently.
+		Every other pass runs on the pool, so this is only called before they start.
+	*/
+	template <typename Storage, typename Compute>
+	void FluidSim2D<Storage, Compute>::ApplyParallelSettings()
+	{
+		const SimSettings& settings = stepParams.settings;
+		Utils::ThreadPool& pool = Utils::ThreadPool::Get();
+		const bool pin = settings.pin_workers || settings.numa_aware;
+		const bool resize = pool.GetWorkerCount() != settings.worker_threads || pool.IsPinned() != pin;
+		if (!resize && Utils::GetParallelBackend() == settings.parallel_backend)
+			return;
+
+		// New threads and slices, so the pages have to follow
+		if (resize) {
+			pool.Resize(settings.worker_threads, pin);
+			numaPlaced = false;
+		}
+		Utils::SetParallelBackend(settings.parallel_backend, settings.worker_threads + 1);
+
+		// Each backend splits and schedules differently, so its grains are tuned afresh
+		for (Utils::GrainTuner& tuner : grainTuners)
+			tuner.Restart();
+	}
+
+	// NUMA node of the pool thread whose seeded slice [count * t / threads, count * (t + 1) / threads)
+	// holds item, -1 when that thread is not pinned
+	static int SliceNode(const Utils::ThreadPool& pool, long long item, long long count)
+	{
+		const long long threads = pool.GetThreadCount();
+		return pool.GetThreadNode(static_cast<int>(std::min(threads - 1, ((item + 1) * threads - 1) / count)));
+	}
+
+	/*
+		Moves each pool thread's slice of every particle array to the node the thread
+		runs on. Run() seeds thread t with the t-th of GetThreadCount() equal slices, and
+		once particles are reordered along a curve neighbouring slots are neighbours in
+		space, so each node holds a contiguous region of the domain and a thread mostly
+		reads its own node's memory until it steals.
+
+		The arrays are value initialised on the allocating thread, so pages are moved
+		after the fact rather than first touched by their owners. Returns the number of
+		pages moved.
+	*/
+	template <typename Storage, typename Compute>
+	int FluidSim2D<Storage, Compute>::PlaceParticlePages()
+	{
+		const Utils::ThreadPool& pool = Utils::ThreadPool::Get();
+		const long long count = particles.Size();
+
+		int moved = 0;
+		particles.ForEachArray([&](auto& array) {
+			const std::size_t item_bytes = sizeof(array[0]);
+			moved += Utils::NumaTopology::Get().PlacePages(array.data(), array.size() * item_bytes,
+				[&](std::size_t offset) { return SliceNode(pool, static_cast<long long>(offset / item_bytes), count); });
+		});
+		return moved;
+	}
+
+	// Pages of the particle arrays on another node than the thread whose slice they hold
+	template <typename Storage, typename Compute>
+	int FluidSim2D<Storage, Compute>::CountRemotePages(int& pages)
+	{
+		const Utils::ThreadPool& pool = Utils::ThreadPool::Get();
+		const long long count = particles.Size();
+
+		int remote = 0;
+		pages = 0;
+		particles.ForEachArray([&](auto& array) {
+			const std::size_t item_bytes = sizeof(array[0]);
+			remote += Utils::NumaTopology::Get().CountMisplacedPages(array.data(), array.size() * item_bytes,
+				[&](std::size_t offset) { return SliceNode(pool, static_cast<long long>(offset / item_bytes), count); }, pages);
+		});
+		return remote;
+	}
+
+	/*
+		Steps an off screen copy of the current scene on each backend this build has,
+		with the current settings otherwise. Every copy starts from the same state and
+		runs COMPARE_WARMUP_STEPS untimed steps, so grains are tuned and lists built
+		before the TIMING_WINDOW steps that are timed.
+	*/
+	template <typename Storage, typename Compute>
+	std::vector<BackendComparison> FluidSim2D<Storage, Compute>::CompareBackends()
+	{
+		const Utils::ParallelBackend selected = SimulationConstants::PARALLEL_BACKEND;
+
+		std::vector<BackendComparison> rows;
+		for (int b = 0; b < Utils::PARALLEL_BACKEND_COUNT; ++b) {
+			const Utils::ParallelBackend backend = static_cast<Utils::ParallelBackend>(b);
+			if (!Utils::IsParallelBackendAvailable(backend))
+				continue;
+
+			SimulationConstants::PARALLEL_BACKEND = backend;
+			FluidSim2D sim(false);
+			sim.particles = particles;
+			sim.stepCount = stepCount;
+			sim.simdLevel = simdLevel;
+			for (int step = 0; step < COMPARE_WARMUP_STEPS; ++step)
+				sim.OnUpdate();
+
+			sim.stepTimings = StageTimings();
+			for (int step = 0; step < TIMING_WINDOW; ++step)
+				sim.OnUpdate();
+			rows.push_back({ backend, sim.shownTimings });
+		}
+
+		// This solver's settings have not changed, so it would not apply its backend again
+		SimulationConstants::PARALLEL_BACKEND = selected;
+		Utils::SetParallelBackend(selected, SimulationConstants::WORKER_THREADS + 1);
+		return rows;
+	}
+
+	/*
+		Steps off screen copies of the current scene without and with NUMA placement.
+		Both run with pinned workers, so placement is the only difference. The copies'
+		arrays are allocated and filled on this thread, as the constructor does, so
+		without placement every page starts on this thread's node and the slices of
+		threads on other nodes count as remote. Accesses are estimated from the
+		kernel's NUMA hinting faults over the timed steps, which need automatic NUMA
+		balancing; without it only ms/step and the page counts tell the rows apart.
+	*/
+	template <typename Storage, typename Compute>
+	std::vector<NumaBenchmark> FluidSim2D<Storage, Compute>::MeasureNumaPlacement()
+	{
+		const bool was_numa_aware = SimulationConstants::NUMA_AWARE;
+		const bool was_pinned = SimulationConstants::PIN_WORKERS;
+		SimulationConstants::PIN_WORKERS = true;
+
+		std::vector<NumaBenchmark> rows;
+		for (bool numa_aware : { false, true }) {
+			SimulationConstants::NUMA_AWARE = numa_aware;
+			FluidSim2D sim(false);
+			sim.particles = particles;
+			sim.stepCount = stepCount;
+			sim.simdLevel = simdLevel;
+			for (int step = 0; step < COMPARE_WARMUP_STEPS; ++step)
+				sim.OnUpdate();
+
+			const Utils::NumaHintFaults before = Utils::NumaTopology::ReadHintFaults();
+			const auto start = std::chrono::steady_clock::now();
+			for (int step = 0; step < TIMING_WINDOW; ++step)
+				sim.OnUpdate();
+			const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			const Utils::NumaHintFaults after = Utils::NumaTopology::ReadHintFaults();
+
+			NumaBenchmark row;
+			row.numa_aware = numa_aware;
+			row.ms_per_step = ms / TIMING_WINDOW;
+			row.remote_pages = sim.CountRemotePages(row.pages);
+			row.moved_pages = sim.numaPagesMoved;
+			row.local_faults = after.local - before.local;
+			row.remote_faults = (after.faults - after.local) - (before.faults - before.local);
+			rows.push_back(row);
+		}
+
+		// The copies resized and pinned the pool for their own settings, so this solver applies its own again
+		SimulationConstants::NUMA_AWARE = was_numa_aware;
+		SimulationConstants::PIN_WORKERS = was_pinned;
+		stepParamsValid = false;
+		return rows;
+	}
+
+	/*
+		Grain of one parallel loop of the step. Per-particle results do not depend
+		on it, and the reductions chunk by a fixed size, so tuning never changes the
+		state a step produces.
+	*/
+	template <typename Storage, typename Compute>
+	Utils::Grain FluidSim2D<Storage, Compute>::PassGrain(PassLoop loop)
+	{
+		if (stepParams.settings.auto_grain)
+			return Utils::Grain(grainTuners[static_cast<int>(loop)]);
+		return Utils::Grain(stepParams.settings.grain_size);
+	}
+
+	/*
+		Lets two runs be compared bit for bit, e.g. a native and a wasm build stepped
+		from the same initial state in deterministic mode. Hashing in external id order
+		makes the result independent of how the particles have been reordered.
+	*/
+	template <typename Storage, typename Compute>
+	uint64_t FluidSim2D<Storage, Compute>::StateHash() const
+	{
+		uint64_t hash = 14695981039346656037ull;
+		auto mix = [&](const void* data, size_t size) {
+			const unsigned char* bytes = static_cast<const unsigned char*>(data);
+			for (size_t b = 0; b < size; ++b) {
+				hash ^= bytes[b];
+				hash *= 1099511628211ull;
+			}
+		};
+
+		for (int id = 0; id < particles.Size(); ++id) {
+			const int k = particles.slot[id];
+			mix(&particles.position[k], sizeof(StorageVec));
+			mix(&particles.velocity[k], sizeof(StorageVec));
+		}
+		return hash;
+	}
 
-				if (particle.position.y > 1.0) {
-					particle.position.y = 1.0;
-					particle.velocity.y *= SimulationConstants::DAMPENING;
+	/*
+		Update the position in RAM on the CPU side and sends that data to the GPU
+	*/
+	template <typename Storage, typename Compute>
+	void FluidSim2D<Storage, Compute>::OnUpdate() 
+	{
+		const auto step_start = std::chrono::steady_clock::now();
+		auto timed = [&](PassStage stage, auto&& pass) { stepTimings.stage_ms[static_cast<int>(stage)] += TimePass(pass); };
+
+		// Nothing below reads the UI settings directly, so they stay fixed for the step
+		const Params& params = UpdateParams();
+
+		// Every force pass overwrites F_pressure and F_viscosity. F_other accumulates and
+		// is cleared by the integration that applies it.
+		if (params.force_terms & TERM_EXTERNAL)
+			HandleMouseInteraction(params);
+
+		// The fused force pass writes the GPU copy as it integrates each particle
+		if (params.fused && params.stage_upload) {
+			uploadPosition.resize(particles.Size());
+			uploadVelocity.resize(particles.Size());
+		}
+
+		if (params.settings.reorder_interval > 0 && stepCount % params.settings.reorder_interval == 0) {
+			timed(PassStage::Grid, [&]() { ReorderParticles(params); });
+		}
+		if (params.numa && !numaPlaced) {
+			numaPagesMoved += PlaceParticlePages();
+			numaPlaced = true;
+		}
+
+		if (params.traversal == Traversal::ClusterPairs) {
+			verletActive = false;
+			pairCache.valid = false;
+			timed(PassStage::Grid, [&]() { UpdateSpatialHashGrid(params); });
+			timed(PassStage::Neighbours, [&]() { BuildClusterPairs(params); });
+			timed(PassStage::Density, [&]() { UpdateParticleDensityClusters(params); });
+			timed(PassStage::Pressure, [&]() { UpdateParticlePressure(params); });
+			timed(PassStage::Forces, [&]() { ComputeForcesClusters(params); });
+		} else if (params.traversal == Traversal::CellTiles) {
+			verletActive = false;
+			pairCache.valid = false;
+			timed(PassStage::Grid, [&]() { UpdateSpatialHashGrid(params); });
+			timed(PassStage::Neighbours, [&]() { BuildOccupancyList(); });
+			timed(PassStage::Density, [&]() { UpdateParticleDensityTiled(params); });
+			if (!params.fused)
+				timed(PassStage::Pressure, [&]() { UpdateParticlePressure(params); });
+			timed(PassStage::Forces, [&]() { ComputeForcesTiled(params); });
+		} else if (params.traversal == Traversal::PerParticle) {
+			const bool compressed = params.settings.compress_neighbour_state;
+			if (!params.settings.verlet_lists) {
+				verletActive = false;
+				timed(PassStage::Grid, [&]() { UpdateSpatialHashGrid(params); });
+			} else {
+				bool rebuild = false;
+				timed(PassStage::Neighbours, [&]() { rebuild = VerletListNeedsRebuild(params); });
+				if (rebuild) {
+					timed(PassStage::Grid, [&]() { UpdateSpatialHashGrid(params); });
+					timed(PassStage::Neighbours, [&]() { BuildVerletList(); });
 				}
 			}
-		);
+			if (compressed)
+				timed(PassStage::Neighbours, [&]() { CompressNeighbourPositions(); });
+			if (params.task_graph) {
+				stepTimings.graph_ms += TimePass([&]() { RunStepGraph(params); });
+			} else {
+				timed(PassStage::Density, [&]() { UpdateParticleDensitySHG(params); });
+				timed(PassStage::Pressure, [&]() {
+					if (!params.fused)
+						UpdateParticlePressure(params);
+					if (compressed)
+						CompressNeighbourFields();
+					if (params.fast_math)
+						UpdateInverseDensity();
+				});
+				timed(PassStage::Forces, [&]() {
+					if (params.symmetric_forces)
+						ComputeForcesSymmetric(params);
+					else
+						ComputeForcesSHG(params);
+				});
+			}
+		} else {
+			verletActive = false;
+			pairCache.valid = false;
+			timed(PassStage::Density, [&]() { UpdateParticleDensity(params); });
+			timed(PassStage::Pressure, [&]() { UpdateParticlePressure(params); });
+			timed(PassStage::Forces, [&]() { ComputeForces(params); });
+		}
 
-		frame_count++;
+		// A fused pass or the task graph has already integrated into the back buffers
+		if (params.fused || params.task_graph)
+			particles.SwapStateBuffers();
+		else
+			timed(PassStage::Integrate, [&]() { Integrate(params); });
+
+		stepCount++;
+		stepTimings.step_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - step_start).count();
+		if (++stepTimings.steps == TIMING_WINDOW) {
+			shownTimings = stepTimings;
+			stepTimings = StageTimings();
+		}
+		// The task graph uploads each block as soon as it has been integrated
+		if (!m_VertexBuffer || params.task_graph)
+			return;
+
+		// Upload the updated position and velocity arrays to the existing GPU buffer,
+		// in external id order once the particles have been reordered and as float
+		// when the state is stored in another type
+		const glm::vec2* upload_position = nullptr;
+		const glm::vec2* upload_velocity = nullptr;
+		if constexpr (std::is_same<Storage, float>::value) {
+			upload_position = particles.position.data();
+			upload_velocity = particles.velocity.data();
+		}
+		if (params.fused && params.stage_upload) {
+			upload_position = uploadPosition.data();
+			upload_velocity = uploadVelocity.data();
+		} else if (params.settings.reorder_interval > 0 || !upload_position) {
+			particles.ToExternalOrder(particles.position, uploadPosition);
+			particles.ToExternalOrder(particles.velocity, uploadVelocity);
+			upload_position = uploadPosition.data();
+			upload_velocity = uploadVelocity.data();
+		}
 
-		// Upload the updated vector to the existing GPU buffer
+		const size_t block_size = particles.Size() * sizeof(glm::vec2);
 		m_VertexBuffer->Bind();
-		GLCall(glBufferSubData(GL_ARRAY_BUFFER, 0, particles.size() * sizeof(Particle), particles.data()));
+		GLCall(glBufferSubData(GL_ARRAY_BUFFER, 0, block_size, upload_position));
+		GLCall(glBufferSubData(GL_ARRAY_BUFFER, block_size, block_size, upload_velocity));
 	}
 
-	void FluidSim2D::OnRender()
+	template <typename Storage, typename Compute>
+	void FluidSim2D<Storage, Compute>::OnRender()
 	{
 		GLCall(glClearColor(0.0f, 0.0f, 0.0f, 1.0f));
 		GLCall(glClear(GL_COLOR_BUFFER_BIT));
@@ -440,7 +2309,8 @@ namespace simulation {
 		renderer.DrawArraySphere(*m_VAO, *m_Shader, SimulationConstants::NO_OF_PARTICLES);
 	}
 
-	void FluidSim2D::OnImGuiRender()
+	template <typename Storage, typename Compute>
+	void FluidSim2D<Storage, Compute>::OnImGuiRender()
 	{
 		float framerate = ImGui::GetIO().Framerate;
 		frame_buffer[array_offset] = framerate;
@@ -459,13 +2329,213 @@ namespace simulation {
 
 		ImGui::Text("Applicaton average %.3f ms/frame (%.1f FPS)", 1000.0f / framerate, framerate);
 		ImGui::Checkbox("Use Spatial Hashing Algorithm", &SimulationConstants::USE_SPATIAL_HASHING);
+		ImGui::Checkbox("Dense Grid (bounded domain)", &SimulationConstants::USE_DENSE_GRID);
+		ImGui::Checkbox("Open Domain (sparse grid, no walls)", &SimulationConstants::OPEN_DOMAIN);
+		ImGui::Text("Sparse cells: %d / %d slots", cellMap.Size(), cellMap.Capacity());
+
+		ImGui::Checkbox("Per-step Pair Cache", &SimulationConstants::USE_PAIR_CACHE);
+		if (SimulationConstants::USE_PAIR_CACHE && stepParamsValid && stepParams.traversal != Traversal::PerParticle)
+			ImGui::Text("Per-particle traversal only");
+		ImGui::Checkbox("Symmetric Forces (Newton's 3rd law)", &SimulationConstants::USE_SYMMETRIC_FORCES);
+		if (NATIVE_FLOAT) {
+			ImGui::Checkbox("Cluster Pair Lists", &SimulationConstants::USE_CLUSTER_PAIRS);
+			if (SimulationConstants::USE_CLUSTER_PAIRS) {
+				const char* sizes[] = { "4", "8" };
+				int size = SimulationConstants::CLUSTER_SIZE == 8 ? 1 : 0;
+				if (ImGui::Combo("Cluster Size", &size, sizes, IM_ARRAYSIZE(sizes)))
+					SimulationConstants::CLUSTER_SIZE = size == 1 ? 8 : 4;
+				ImGui::Text("Clusters: %d, cluster pairs: %d", clusterList.GetClusterCount(), clusterList.GetPairCount());
+			}
+			const char* simd_levels[] = { "Scalar", "SSE4.2", "AVX2" };
+			int simd_level = static_cast<int>(simdLevel);
+			if (ImGui::Combo("SIMD Kernels", &simd_level, simd_levels, static_cast<int>(simdSupported) + 1))
+				simdLevel = static_cast<SimdLevel>(simd_level);
+			ImGui::Text("CPU supports %s, used by pressure, integration and cell tiles", GetSimdLevelName(simdSupported));
+		}
+
+		ImGui::Checkbox("Cell Tiled Traversal", &SimulationConstants::USE_CELL_TILES);
+		if (SimulationConstants::USE_CELL_TILES)
+			ImGui::Text("Occupied cells: %d of %d", static_cast<int>(activeCells.size()), grid.GetCellCount());
+		ImGui::Checkbox("Fused Passes", &SimulationConstants::FUSED_PASSES);
+		if (SimulationConstants::FUSED_PASSES && stepParamsValid && !stepParams.fused)
+			ImGui::Text("Not used by the cluster, symmetric or all pairs passes");
+		const char* balances[] = { "Off (grain, work stealing)", "Uniform chunks", "Cost model" };
+		int balance = static_cast<int>(SimulationConstants::LOAD_BALANCE);
+		if (ImGui::Combo("Load Balancing", &balance, balances, IM_ARRAYSIZE(balances)))
+			SimulationConstants::LOAD_BALANCE = static_cast<LoadBalance>(balance);
+		if (stepParamsValid && stepParams.load_balance != LoadBalance::Off) {
+			const std::pair<const char*, const Utils::ThreadBusy*> passes[] = { { "density", &densityBusy }, { "forces", &forcesBusy } };
+			for (const auto& pass : passes) {
+				ImGui::Text("  %s: %d chunks, imbalance %.2f, busy ms/thread:", pass.first, loadBalancer.GetChunkCount(), pass.second->imbalance);
+				for (double ms : pass.second->ms) {
+					ImGui::SameLine();
+					ImGui::Text("%.3f", ms);
+				}
+			}
+		} else if (SimulationConstants::LOAD_BALANCE != LoadBalance::Off) {
+			ImGui::Text("Only used by the per-particle passes without the task graph");
+		}
+		ImGui::Checkbox("Task Graph Step", &SimulationConstants::USE_TASK_GRAPH);
+		if (SimulationConstants::USE_TASK_GRAPH && stepParamsValid && stepParams.task_graph)
+			ImGui::Text("%d tasks over %d blocks, %d dependencies", stepGraph.GetTaskCount(), stepGraphBlocks, stepGraph.GetEdgeCount());
+#ifndef __EMSCRIPTEN__
+		const int max_workers = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+		ImGui::SliderInt("Worker Threads", &SimulationConstants::WORKER_THREADS, 0, max_workers);
+		ImGui::Checkbox("Pin Workers to Cores", &SimulationConstants::PIN_WORKERS);
+		const Utils::NumaTopology& topology = Utils::NumaTopology::Get();
+		ImGui::Checkbox("NUMA-aware Placement (thread pool)", &SimulationConstants::NUMA_AWARE);
+		ImGui::Text("%d NUMA node%s, %d particle pages moved", topology.GetNodeCount(), topology.GetNodeCount() == 1 ? "" : "s", numaPagesMoved);
+		if (ImGui::Button("Benchmark NUMA Placement"))
+			numaBenchmarks = MeasureNumaPlacement();
+		for (const NumaBenchmark& row : numaBenchmarks) {
+			ImGui::Text("%s: %.3f ms/step, %d of %d pages remote, %d moved", row.numa_aware ? "NUMA-aware" : "First touch on main",
+				row.ms_per_step, row.remote_pages, row.pages, row.moved_pages);
+			ImGui::Text("    NUMA hinting faults: %lld local, %lld remote", row.local_faults, row.remote_faults);
+		}
+		if (!numaBenchmarks.empty())
+			ImGui::Text("Faults stay 0 unless kernel.numa_balancing is on; then only ms/step and pages compare");
+#endif
+		// Only the backends this build was compiled with are offered
+		if (ImGui::BeginCombo("Parallel Backend", Utils::GetParallelBackendName(SimulationConstants::PARALLEL_BACKEND))) {
+			for (int b = 0; b < Utils::PARALLEL_BACKEND_COUNT; ++b) {
+				const Utils::ParallelBackend backend = static_cast<Utils::ParallelBackend>(b);
+				if (Utils::IsParallelBackendAvailable(backend) &&
+					ImGui::Selectable(Utils::GetParallelBackendName(backend), backend == SimulationConstants::PARALLEL_BACKEND))
+					SimulationConstants::PARALLEL_BACKEND = backend;
+			}
+			ImGui::EndCombo();
+		}
+		const char* stage_names[PASS_STAGE_COUNT] = { "grid", "neighbours", "density", "pressure", "forces", "integrate" };
+		auto stage_times = [&](const StageTimings& timings) {
+			const double steps = std::max(1, timings.steps);
+			ImGui::Text("  %.3f ms/step:", timings.step_ms / steps);
+			for (int stage = 0; stage < PASS_STAGE_COUNT; ++stage) {
+				if (timings.stage_ms[stage] > 0.0) {
+					ImGui::SameLine();
+					ImGui::Text("%s %.3f", stage_names[stage], timings.stage_ms[stage] / steps);
+				}
+			}
+			if (timings.graph_ms > 0.0) {
+				ImGui::SameLine();
+				ImGui::Text("task graph %.3f", timings.graph_ms / steps);
+			}
+		};
+		ImGui::Text("Stage times over the last %d steps (ms/step)", TIMING_WINDOW);
+		stage_times(shownTimings);
+		if (ImGui::Button("Compare Parallel Backends"))
+			backendComparison = CompareBackends();
+		for (const BackendComparison& row : backendComparison) {
+			ImGui::Text("%s", Utils::GetParallelBackendName(row.backend));
+			stage_times(row.timings);
+		}
+		ImGui::Checkbox("Auto-tune Grain", &SimulationConstants::AUTO_GRAIN);
+		if (SimulationConstants::AUTO_GRAIN) {
+			const char* loop_names[PASS_LOOP_COUNT] = { "grid keys", "reorder keys", "Verlet build", "pair cache reserve",
+				"compress positions", "density", "density tiles", "pressure", "compress fields", "inverse density", "forces",
+				"symmetric forces", "force tiles", "integrate" };
+			for (int loop = 0; loop < PASS_LOOP_COUNT; ++loop) {
+				const Utils::GrainTuner& tuner = grainTuners[loop];
+				ImGui::Text("  %s: %d%s", loop_names[loop], tuner.Next(), tuner.IsExploring() ? " (tuning)" : "");
+			}
+		} else {
+			ImGui::SliderInt("Grain Size", &SimulationConstants::GRAIN_SIZE, Utils::GrainTuner::MIN_GRAIN, Utils::GrainTuner::MAX_GRAIN);
+		}
+		ImGui::Checkbox("Deterministic (bit exact on every build)", &SimulationConstants::DETERMINISTIC);
+		if (SimulationConstants::DETERMINISTIC)
+			ImGui::Text("Step %d, state hash %016llx", stepCount, static_cast<unsigned long long>(StateHash()));
+		ImGui::Checkbox("Fast Approximate Math", &SimulationConstants::FAST_MATH);
+		if (ImGui::Button("Measure Approximation Error")) {
+			approximationReport = MeasureApproximationError();
+			hasApproximationReport = true;
+		}
+		if (hasApproximationReport) {
+			const std::pair<const char*, const PassError*> rows[] = {
+				{ "Density", &approximationReport.density },
+				{ "Pressure force", &approximationReport.pressure_force },
+				{ "Viscous force", &approximationReport.viscosity_force },
+			};
+			for (const auto& row : rows) {
+				ImGui::Text("%s: max %.2e, rms %.2e (%.3f -> %.3f ms)", row.first, row.second->max_error,
+					row.second->rms_error, row.second->exact_ms, row.second->approximate_ms);
+			}
+		}
+		ImGui::Checkbox("Compressed Neighbour State", &SimulationConstants::COMPRESS_NEIGHBOUR_STATE);
+		if (SimulationConstants::COMPRESS_NEIGHBOUR_STATE)
+			ImGui::Text("Per-particle passes, neighbours read %d of %d bytes, position error <= %.1e",
+				CompressedNeighbourState::BYTES_PER_PARTICLE, static_cast<int>(2 * sizeof(StorageVec) + 2 * sizeof(Storage)),
+				gridCellSize / (2.0f * CompressedNeighbourState::OFFSET_SCALE));
+		ImGui::Checkbox("Verlet Neighbour Lists", &SimulationConstants::USE_VERLET_LISTS);
+		if (SimulationConstants::USE_VERLET_LISTS) {
+			if (stepParamsValid && stepParams.traversal != Traversal::PerParticle)
+				ImGui::Text("Per-particle traversal only");
+			ImGui::SliderFloat("Verlet Skin (x h)", &SimulationConstants::VERLET_SKIN, 0.05f, 1.0f);
+			ImGui::Text("List rebuilds: %d of %d steps, %d pairs", verletBuilds, stepCount, verletList.Size());
+		}
+
+		const char* curves[] = { "Morton", "Hilbert" };
+		int curve = static_cast<int>(SimulationConstants::REORDER_CURVE);
+		ImGui::SliderInt("Reorder Interval (0 = off)", &SimulationConstants::REORDER_INTERVAL, 0, 200);
+		if (ImGui::Combo("Reorder Curve", &curve, curves, IM_ARRAYSIZE(curves)))
+			SimulationConstants::REORDER_CURVE = static_cast<SimulationConstants::Curve>(curve);
+		ImGui::Checkbox("Collect Grid Statistics", &SimulationConstants::COLLECT_GRID_STATS);
+		if (SimulationConstants::COLLECT_GRID_STATS) {
+			const long long wasted = gridStats.hashed_candidates - gridStats.exact_candidates;
+			ImGui::Text("Candidates/step: hashed %lld, exact %lld", gridStats.hashed_candidates, gridStats.exact_candidates);
+			ImGui::Text("Wasted pairs eliminated: %lld (%.1f%%)", wasted,
+				gridStats.hashed_candidates > 0 ? 100.0 * wasted / gridStats.hashed_candidates : 0.0);
+			ImGui::Text("Avg neighbour index distance: %.1f",
+				gridStats.neighbour_pairs > 0 ? double(gridStats.neighbour_index_distance) / gridStats.neighbour_pairs : 0.0);
+		}
 		ImGui::Separator();
 
+		ImGui::Text("Hot state: %d bytes/particle", static_cast<int>(2 * sizeof(StorageVec) + 2 * sizeof(Storage)));
+		if (ImGui::Button("Benchmark Storage Types")) {
+			const int steps = 200;
+			benchmarks = {
+				FluidSim2D<double>::RunBenchmark("double", steps),
+				FluidSim2D<float>::RunBenchmark("float", steps),
+				FluidSim2D<Half, float>::RunBenchmark("half storage, float compute", steps),
+				FluidSim2D<float>::RunBenchmark("float, compressed neighbours", steps, true),
+			};
+
+			// Errors are measured against the double run
+			for (PrecisionBenchmark& row : benchmarks) {
+				double sum2 = 0.0;
+				for (size_t k = 0; k < row.positions.size(); ++k) {
+					const double error = glm::length(row.positions[k] - benchmarks[0].positions[k]);
+					row.max_error = std::max(row.max_error, error);
+					sum2 += error * error;
+				}
+				row.rms_error = std::sqrt(sum2 / std::max<size_t>(row.positions.size(), 1));
+			}
+		}
+		for (const PrecisionBenchmark& row : benchmarks) {
+			ImGui::Text("%s: %d B/particle, %.2f ms/step", row.name.c_str(), row.hot_bytes, row.ms_per_step);
+			ImGui::Text("    estimated neighbour reads: %.2f MB/step, %.2f GB/s", row.neighbour_bytes * 1e-6,
+				row.estimated_gb_per_s);
+			ImGui::Text("    position error vs double: max %.2e, rms %.2e", row.max_error, row.rms_error);
+		}
+		ImGui::Separator();
+
+		const char* kernel_shapes[KERNEL_SHAPE_COUNT];
+		for (int shape = 0; shape < KERNEL_SHAPE_COUNT; ++shape)
+			kernel_shapes[shape] = GetKernelShapeName(static_cast<KernelShape>(shape));
+		int kernel_shape = static_cast<int>(PhysicsConstants::KERNEL_SHAPE);
+		if (ImGui::Combo("SPH Kernel", &kernel_shape, kernel_shapes, KERNEL_SHAPE_COUNT))
+			PhysicsConstants::KERNEL_SHAPE = static_cast<KernelShape>(kernel_shape);
+
 		ImGui::SliderFloat("Density (kg/m^2)", &PhysicsConstants::REST_DENSITY, 1.0f, 3000.0f);
-		ImGui::SliderFloat("Viscosity (Pa*s)", &PhysicsConstants::VISCOCITY_COEFFICIENT, 0.001f, 0.1f);
+		ImGui::SliderFloat("Viscosity (Pa*s)", &PhysicsConstants::VISCOCITY_COEFFICIENT, 0.0f, 0.1f);
 		ImGui::SliderFloat("Volume of each drop (m^2)", &PhysicsConstants::MASS, 0.25f, 1.5f);
-		ImGui::SliderFloat("Gravity (m/s^2)", &PhysicsConstants::GRAVITY, 1.0f, 25.0f);
+		ImGui::SliderFloat("Gravity (m/s^2)", &PhysicsConstants::GRAVITY, 0.0f, 25.0f);
 		ImGui::SliderFloat("Wall Damping", &SimulationConstants::DAMPENING, -1.0f, 1.0f);
+		const unsigned terms = stepParams.force_terms;
+		ImGui::Text("Active terms: %s%s%s%s%s",
+			(terms & TERM_VISCOSITY) ? "viscosity " : "",
+			(terms & TERM_EXTERNAL) ? "mouse " : "",
+			(terms & TERM_GRAVITY) ? "gravity " : "",
+			(terms & TERM_WALLS) ? "walls " : "",
+			(terms & TERM_WALL_DAMPING) ? "damping" : "");
 
 		#ifndef __EMSCRIPTEN__
 			ImGui::SliderFloat("Smoothing Radius", &PhysicsConstants::SMOOTHING_RADIUS, 0.05f, 3.0f);
@@ -493,4 +2563,8 @@ namespace simulation {
 
 
 	}
-}
\ No newline at end of file
+
+	template class FluidSim2D<float>;
+	template class FluidSim2D<double>;
+	template class FluidSim2D<Half, float>;
+}
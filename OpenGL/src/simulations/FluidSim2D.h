@@ -1,6 +1,24 @@
 #pragma once
 
 #include "Simulation.h"
+#include "ParticleStore.h"
+#include "CellBinner.h"
+#include "SparseCellMap.h"
+#include "NeighbourList.h"
+#include "ClusterPairList.h"
+#include "SimdKernels.h"
+#include "SphKernels.h"
+#include "ForceTerms.h"
+#include "Half.h"
+#include "CompressedState.h"
+#include "FastMath.h"
+#include "SimParams.h"
+#include "SphCore.h"
+#include "UniformGrid.h"
+#include "TaskGraph.h"
+#include "LoadBalancer.h"
+#include "NumaTopology.h"
+#include "Utils.h"
 
 #include "VertexBuffer.h"
 #include "VertexBufferLayout.h"
@@ -11,42 +29,9 @@
 #include <array>
 #include <algorithm>
 #include <numeric>
-
-#ifndef __EMSCRIPTEN__
-	#include <execution>
-#endif
-
-namespace Utils {
-	template <typename Iterator, typename T>
-	void ParallelFill(Iterator begin, Iterator end, const T& val)
-	{
-#ifdef __EMSCRIPTEN__
-		std::fill(begin, end, val);
-#else
-		std::fill(std::execution::par_unseq, begin, end, val);
-#endif
-	}
-
-	template <typename Iterator, typename Func>
-	void ParallelForEach(Iterator begin, Iterator end, Func func)
-	{
-#ifdef __EMSCRIPTEN__
-		std::for_each(begin, end, func);
-#else
-		std::for_each(std::execution::par_unseq, begin, end, func);
-#endif
-	}
-
-	template <typename Iterator, typename Compare>
-	void ParallelSort(Iterator begin, Iterator end, Compare comp)
-	{
-#ifdef __EMSCRIPTEN__
-		std::sort(begin, end, comp);
-#else
-		std::sort(std::execution::par_unseq, begin, end, comp);
-#endif
-	}
-}
+#include <string>
+#include <cstdint>
+#include <type_traits>
 
 constexpr float calculate_r6(float r) {
 	float r2 = r * r;
@@ -68,15 +53,9 @@ namespace PhysicsConstants {
 	inline static float VISCOCITY_COEFFICIENT = 0.016;
 	inline static float GASS_CONSTANT = 0.420f;
 	inline static float GRAVITY = 9.81f;
-	inline static float Poly6Kernal() {
-		return 4.0f / (PhysicsConstants::PI * calculate_r8(PhysicsConstants::SMOOTHING_RADIUS));
-	}
-	inline static float SpikeyConstant() {
-		return -45.0f / (PhysicsConstants::PI * calculate_r6(PhysicsConstants::SMOOTHING_RADIUS));
-	}
-	inline static float MullerConstant() {
-		return 45.0f / (PhysicsConstants::PI * calculate_r6(PhysicsConstants::SMOOTHING_RADIUS));
-	}
+
+	// Smoothing kernel used by every density and force pass
+	inline static simulation::KernelShape KERNEL_SHAPE = simulation::KernelShape::Poly6Spiky;
 }
 
 namespace SimulationConstants {
@@ -85,18 +64,86 @@ namespace SimulationConstants {
 #else
 	static constexpr int NO_OF_PARTICLES = 2500;
 #endif
-	static constexpr int TABLE_SIZE = NO_OF_PARTICLES * 2;
+	static constexpr int LEGACY_TABLE_SIZE = NO_OF_PARTICLES * 2;
 	static constexpr int PRIME1 = 98561123;
 	static constexpr int PRIME2 = 863421509;
 	static constexpr float SAFETY_FACTOR = 0.40f;
+	static constexpr float DOMAIN_MIN = -1.0f;
+	static constexpr float DOMAIN_MAX = 1.0f;
 
 	inline static float DAMPENING = -0.3f;
 	inline static float GRAB_RADIUS = 0.3f;
 	inline static float GRAB_STRENGTH = -12000.0f;
 	inline static bool USE_SPATIAL_HASHING = true;
-	static float MaxSpeed() {
-		return PhysicsConstants::SMOOTHING_RADIUS* SAFETY_FACTOR / GlobalConstants::DT;
-	}
+	inline static bool USE_DENSE_GRID = true;
+	inline static bool OPEN_DOMAIN = false;
+
+	// Space-filling curve used to reorder particles every REORDER_INTERVAL steps
+	using Curve = simulation::ReorderCurve;
+	inline static Curve REORDER_CURVE = Curve::Hilbert;
+	inline static int REORDER_INTERVAL = 50;
+
+	/*
+		Neighbour lists with radius h * (1 + VERLET_SKIN), reused across steps. Off by
+		default: the pair cache already saves the second neighbour walk, and filling it
+		from the skinned list visits more candidates than the rebuilds save.
+	*/
+	inline static bool USE_VERLET_LISTS = false;
+	inline static float VERLET_SKIN = 0.3f;
+
+	// Record interacting pairs in the density pass for reuse by the force pass
+	inline static bool USE_PAIR_CACHE = false;
+
+	// Evaluate each pair once and apply it to both particles
+	inline static bool USE_SYMMETRIC_FORCES = false;
+
+	// Evaluate fixed size cluster x cluster tiles instead of per-particle neighbour loops
+	inline static bool USE_CLUSTER_PAIRS = false;
+	inline static int CLUSTER_SIZE = 4;
+
+	// Walk the occupied cells, gathering each 3x3 neighbourhood into a contiguous tile
+	inline static bool USE_CELL_TILES = true;
+
+	// Per-particle passes read neighbours from a quantised copy of the hot state
+	inline static bool COMPRESS_NEIGHBOUR_STATE = false;
+
+	// Bit identical steps on every build and thread count, see FluidSim2D::StateHash
+	inline static bool DETERMINISTIC = false;
+
+	// Per-particle passes use tabulated kernels, FastInverseSqrt and 1 / density
+	inline static bool FAST_MATH = false;
+
+	// Compute pressure inside the density pass and integrate inside the force pass
+	inline static bool FUSED_PASSES = false;
+
+	// Run the per-particle step as a graph of tasks over blocks of TASK_BLOCK_SIZE particles
+	inline static bool USE_TASK_GRAPH = false;
+	static constexpr int TASK_BLOCK_SIZE = 128;
+
+	// Split the per-particle passes by the previous step's neighbour candidate counts
+	inline static simulation::LoadBalance LOAD_BALANCE = simulation::LoadBalance::Off;
+
+	// Particles per task for the vectorised per-particle passes
+	static constexpr int SIMD_BLOCK_SIZE = 256;
+
+	// Threads besides the caller in Utils::ThreadPool, each optionally pinned to a core
+	inline static int WORKER_THREADS = Utils::ThreadPool::DefaultWorkerCount();
+	inline static bool PIN_WORKERS = false;
+
+	/*
+		Pin the workers node by node and keep each pool thread's slice of the particle
+		arrays on the thread's NUMA node, see FluidSim2D::PlaceParticlePages
+	*/
+	inline static bool NUMA_AWARE = false;
+
+	// What Utils::ParallelFor runs on, see Utils::ParallelBackend
+	inline static Utils::ParallelBackend PARALLEL_BACKEND = Utils::DefaultParallelBackend();
+
+	// Particles per task of the per-particle passes, or timed per pass with AUTO_GRAIN
+	inline static int GRAIN_SIZE = Utils::DEFAULT_GRAIN;
+	inline static bool AUTO_GRAIN = true;
+
+	inline static bool COLLECT_GRID_STATS = false;
 }
 
 namespace Init {
@@ -108,42 +155,247 @@ namespace Init {
 }
 
 namespace simulation {
+	// One row of the storage type benchmark, see FluidSim2D::RunBenchmark
+	struct PrecisionBenchmark {
+		std::string name;
+		int hot_bytes = 0;				// Bytes of hot state per particle
+		double ms_per_step = 0.0;
+		double neighbour_bytes = 0.0;		// Hot state the pair loops read per step, estimated from the candidate counts
+		double estimated_gb_per_s = 0.0;	// neighbour_bytes over the measured step time, not a measured bandwidth
+		double max_error = 0.0;			// Position error against the double run
+		double rms_error = 0.0;
+		std::vector<glm::dvec2> positions;	// Final positions in external id order
+	};
+
+	// Deviation of one approximate pass from the exact one, see FluidSim2D::MeasureApproximationError
+	struct PassError {
+		double max_error = 0.0;			// |approximate - exact| / RMS |exact|
+		double rms_error = 0.0;
+		double exact_ms = 0.0;
+		double approximate_ms = 0.0;
+	};
+
+	// Stages of a step, timed separately
+	enum class PassStage {
+		Grid,
+		Neighbours,
+		Density,
+		Pressure,
+		Forces,
+		Integrate,
+		Count
+	};
+
+	static constexpr int PASS_STAGE_COUNT = static_cast<int>(PassStage::Count);
+
+	/*
+		Parallel loops of a step, each with its own grain when it is tuned. Loops in one
+		stage can differ in cost per item by an order of magnitude, and the tile passes
+		iterate over cells rather than particles, so none of them share a tuner.
+	*/
+	enum class PassLoop {
+		GridKeys,
+		ReorderKeys,
+		VerletBuild,
+		PairCacheReserve,
+		CompressPositions,
+		Density,
+		DensityTiles,
+		Pressure,
+		CompressFields,
+		InverseDensity,
+		Forces,
+		ForcesSymmetric,
+		ForcesTiles,
+		Integrate,
+		Count
+	};
+
+	static constexpr int PASS_LOOP_COUNT = static_cast<int>(PassLoop::Count);
+
+	// Wall time spent in each stage of the solver over `steps` steps
+	struct StageTimings {
+		double stage_ms[PASS_STAGE_COUNT] = {};
+		double graph_ms = 0.0;			// The task graph step, density to integrate
+		double step_ms = 0.0;
+		int steps = 0;
+	};
+
+	// One row of the NUMA benchmark, see FluidSim2D::MeasureNumaPlacement
+	struct NumaBenchmark {
+		bool numa_aware = false;
+		double ms_per_step = 0.0;
+		int pages = 0;					// Whole pages of the particle arrays
+		int remote_pages = 0;			// Pages on another node than the thread whose slice they hold
+		int moved_pages = 0;			// Pages placement moved, reorders included
+		long long local_faults = 0;		// NUMA hinting faults over the timed steps, see Utils::NumaHintFaults
+		long long remote_faults = 0;
+	};
+
+	// One row of the backend comparison, see FluidSim2D::CompareBackends
+	struct BackendComparison {
+		Utils::ParallelBackend backend;
+		StageTimings timings;
+	};
+
+	struct ApproximationReport {
+		PassError density;
+		PassError pressure_force;
+		PassError viscosity_force;
+	};
+
+	/*
+		The solver is templated on the type particle state is stored in and the type it
+		is computed in. FluidSim2D<> is the interactive float solver, FluidSim2D<double>
+		is the reference for validating long runs and FluidSim2D<Half, float> halves the
+		bytes the neighbour loops stream. All three are instantiated in FluidSim2D.cpp.
+
+		The SIMD kernels and cluster pair lists are written for float and are only
+		available in FluidSim2D<float>; the other instantiations fall back to the scalar
+		paths.
+	*/
+	template <typename Storage = float, typename Compute = Storage>
 	class FluidSim2D : public Simulation
 	{
 	public:
-		struct Particle {
-			glm::vec2 position;
-			glm::vec2 velocity;
-			glm::vec2 acceleration;
-			float density;
-			float pressure;
-			glm::vec2 F_pressure;
-			glm::vec2 F_viscosity;
-			glm::vec2 F_other;
-			glm::vec3 colour;
-		};
+		using Vec = glm::vec<2, Compute>;
+		using StorageVec = glm::vec<2, Storage>;
+
+		using Params = SimParams<Compute>;
+
+		static constexpr bool NATIVE_FLOAT = std::is_same<Storage, float>::value && std::is_same<Compute, float>::value;
 
 		FluidSim2D();
+		// Without GPU buffers the solver can be stepped off screen, e.g. for benchmarks
+		explicit FluidSim2D(bool createGpuBuffers);
 		~FluidSim2D();
 
-		void ResetForces();
+		// Runs `steps` steps from the standard initial state on scalar code
+		static PrecisionBenchmark RunBenchmark(const char* name, int steps, bool compressed = false);
+
+		// Times steps of the current scene on every available parallel backend
+		std::vector<BackendComparison> CompareBackends();
+
+		// Steps the current scene with and without NUMA placement
+		std::vector<NumaBenchmark> MeasureNumaPlacement();
+
+		// Captures this step's SimParams, recomputing what depends on a changed setting
+		const Params& UpdateParams();
+
 		glm::vec2 GetMouseWorldPos();
-		void HandleMouseInteraction();
+		void HandleMouseInteraction(const Params& params);
+
+		void UpdateSpatialHashGrid(const Params& params);
+		void MeasureGridStats(const Params& params);
+		void ReorderParticles(const Params& params);
+		bool VerletListNeedsRebuild(const Params& params) const;
+		void BuildVerletList();
+		void UpdateParticleDensity(const Params& params);
+		void UpdateParticleDensitySHG(const Params& params);
+
+		void UpdateParticlePressure(const Params& params);
+		void RunStepGraph(const Params& params);
+
+		void ComputeForces(const Params& params);
+		void ComputeForcesSHG(const Params& params);
+		void ComputeForcesSymmetric(const Params& params);
+
+		void BuildClusterPairs(const Params& params);
+		void UpdateParticleDensityClusters(const Params& params);
+		void ComputeForcesClusters(const Params& params);
+
+		void BuildOccupancyList();
+		void UpdateParticleDensityTiled(const Params& params);
+		void ComputeForcesTiled(const Params& params);
 
-		void UpdateSpatialHashGrid();
-		void UpdateParticleDensity();
-		void UpdateParticleDensitySHG();
+		void CompressNeighbourPositions();
+		void CompressNeighbourFields();
 
-		void UpdateParticlePressure();
+		void UpdateInverseDensity();
+		ApproximationReport MeasureApproximationError();
 
-		void ComputeForces();
-		void ComputeForcesSHG();
+		void Integrate(const Params& params);
+
+		// FNV-1a of every position and velocity bit, in external id order
+		uint64_t StateHash() const;
 
 		void OnUpdate() override;
 		void OnRender() override;
 		void OnImGuiRender() override;
 
 	private:
+		struct GridStats {
+			long long hashed_candidates = 0;
+			long long exact_candidates = 0;
+			long long neighbour_pairs = 0;
+			long long neighbour_index_distance = 0;
+		};
+
+		struct ActiveCell {
+			int key;
+			glm::ivec2 coord;
+		};
+
+		void DeriveParams(const SimSettings& settings);
+		void ApplyParallelSettings();
+		int PlaceParticlePages();
+		int CountRemotePages(int& pages);
+		void ReservePairCache(const Params& params);
+		void UpdateBlockNeighbours(int blockSize, int blockCount);
+		Utils::Grain PassGrain(PassLoop loop);
+		Traversal SelectTraversal(const SimSettings& settings) const;
+		SimdLevel ActiveSimdLevel(const SimSettings& settings) const;
+		bool UseSymmetricForces(const SimSettings& settings) const;
+		bool UseFastMath(const SimSettings& settings) const;
+		unsigned ActiveForceTerms(const SimSettings& settings) const;
+
+		struct KernelPasses;
+		static const KernelPasses& GetKernelPasses(const Params& params, bool approximate);
+
+		using IntegratePass = void (*)(FluidSim2D& sim, const Params& params);
+		struct IntegrateFactory;
+		static int HasViscosity(const Params& params);
+
+		template <typename Kernel>
+		void UpdateParticleDensity(const Params& params, const Kernel& kernel);
+		template <typename Kernel, bool Compressed>
+		void UpdateParticleDensitySHG(const Params& params, const Kernel& kernel);
+		template <typename Kernel, bool Compressed>
+		void UpdateParticleDensitySHG(const Params& params, const Kernel& kernel, int begin, int end);
+		template <typename Kernel>
+		void UpdateParticleDensityTiled(const Params& params, const Kernel& kernel);
+		template <typename Kernel, unsigned Terms>
+		void ComputeForces(const Params& params, const Kernel& kernel);
+		template <typename Kernel, unsigned Terms, bool Compressed>
+		void ComputeForcesSHG(const Params& params, const Kernel& kernel);
+		template <typename Kernel, unsigned Terms, bool Compressed>
+		void ComputeForcesSHG(const Params& params, const Kernel& kernel, int begin, int end);
+
+		// The per-particle work of a pass over particles [begin, end)
+		void UpdateParticlePressure(const Params& params, int begin, int end);
+		void CompressNeighbourFields(int begin, int end);
+		void UpdateInverseDensity(int begin, int end);
+		template <typename Kernel, unsigned Terms>
+		void ComputeForcesSymmetric(const Params& params, const Kernel& kernel);
+		template <typename Kernel, unsigned Terms>
+		void ComputeForcesTiled(const Params& params, const Kernel& kernel);
+
+		template <unsigned Terms>
+		void Integrate(const Params& params);
+		template <unsigned Terms>
+		void IntegrateParticle(const IntegrateConstants<Compute>& integrate, int i, const Vec& F_pressure,
+			const Vec& F_viscosity, StorageVec& position_out, StorageVec& velocity_out);
+		void IntegrateFused(const IntegrateConstants<Compute>& integrate, bool stage_upload, int i,
+			const Vec& F_pressure, const Vec& F_viscosity);
+
+		template <typename Func>
+		void ForEachCandidateRange(const Vec& position, int range, Func&& func) const;
+		template <typename Func>
+		void ForEachCellRange(const glm::ivec2& coord, int range, Func&& func) const;
+		template <typename Func>
+		void ForEachNeighbourCandidate(int i, const Vec& position, Func&& func) const;
+		int CandidateCount(int i, const Vec& position) const;
+
 		std::unique_ptr<VertexArray> m_VAO;
 		std::unique_ptr<VertexBuffer> m_VertexBuffer;
 		std::unique_ptr<IndexBuffer> m_IndexBuffer;
@@ -153,24 +405,77 @@ namespace simulation {
 		glm::mat4 m_Proj, m_View;
 		glm::vec3 m_TranslationA, m_TranslationB;
 
-		std::vector<Particle> particles;
+		BasicParticleStore<Storage, Compute> particles;
+		AlignedVector<glm::vec2> uploadPosition;
+		AlignedVector<glm::vec2> uploadVelocity;
 		float prev_time;
+		int stepCount = 0;
+
+		Params stepParams;
+		bool stepParamsValid = false;
+
+		CellBinner grid;
+		SparseCellMap cellMap;
+		// False until the grid is built, and again once ReorderParticles() has moved its particles
+		bool gridSlotsValid = false;
+		bool gridDense = true;
+		float gridCellSize = 0.0f;
+		DenseGridLayout<2> gridLayout;
+		GridStats gridStats;
+
+		NeighbourList<int> verletList;
+		AlignedVector<StorageVec> verletPositions;
+		bool verletActive = false;
+		float verletRadius = 0.0f;
+		int verletBuilds = 0;
+
+		PairCache<Compute> pairCache;
+		CompressedNeighbourState compressedState;
+		AlignedVector<Compute> inverseDensity;
+		ClusterPairList clusterList;
+		std::vector<ActiveCell> activeCells;
 
-		std::vector<std::array<int, 2>> spatialHash =
-			std::vector<std::array<int, 2>>(SimulationConstants::NO_OF_PARTICLES, {INT_MAX, INT_MAX});
+		SimdLevel simdSupported = DetectSimdLevel();
+		SimdLevel simdLevel = simdSupported;
+		std::array<Utils::GrainTuner, PASS_LOOP_COUNT> grainTuners;
 
-		std::vector<int> indices =
-			std::vector<int>(SimulationConstants::TABLE_SIZE, -1);
+		// Neighbour candidates of each particle, counted by the density pass
+		Utils::LoadBalancer loadBalancer;
+		Utils::ThreadBusy densityBusy;
+		Utils::ThreadBusy forcesBusy;
 
-		std::vector<int> iter_idx = 
-			[]() {
-				std::vector<int> v(SimulationConstants::NO_OF_PARTICLES);
-				std::iota(v.begin(), v.end(), 0);
-				return v;
-			}();
+		// Particle pages are on their threads' nodes until the arrays are reallocated
+		bool numaPlaced = false;
+		int numaPagesMoved = 0;
+		std::vector<NumaBenchmark> numaBenchmarks;
+
+		// Stage times of the steps so far and of the last full window shown in the UI
+		StageTimings stepTimings;
+		StageTimings shownTimings;
+		std::vector<BackendComparison> backendComparison;
+
+		Utils::TaskGraph stepGraph;
+		int stepGraphBlocks = 0;
+		// Bit b is set when the cell holds a particle of task block b
+		std::vector<uint64_t> cellBlocks;
+		// Blocks holding a neighbour candidate of some particle of each block
+		std::vector<uint64_t> blockNeighbours;
+
+		AlignedVector<Vec> chunkPressure;
+		AlignedVector<Vec> chunkViscosity;
+
+		std::vector<int> cellKeys =
+			std::vector<int>(SimulationConstants::NO_OF_PARTICLES, 0);
 		
 		std::array<float, 90> frame_buffer = {};
 		int array_offset = 0;
 
+		std::vector<PrecisionBenchmark> benchmarks;
+		ApproximationReport approximationReport;
+		bool hasApproximationReport = false;
 	};
+
+	extern template class FluidSim2D<float>;
+	extern template class FluidSim2D<double>;
+	extern template class FluidSim2D<Half, float>;
 }
\ No newline at end of file
@@ -0,0 +1,364 @@
+#include "FluidSim3D.h"
+
+#include "Renderer.h"
+#include "imgui/imgui.h"
+
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+namespace simulation {
+	FluidSim3D::FluidSim3D()
+		: FluidSim3D(true)
+	{
+	}
+
+	FluidSim3D::FluidSim3D(bool createGpuBuffers)
+	{
+		using namespace Simulation3DConstants;
+		particles.Resize(NO_OF_PARTICLES);
+
+		// A jittered cube in the lower corner, the same way every time
+		uint32_t jitter = 2463534242u;
+		for (int i = 0; i < NO_OF_PARTICLES; ++i) {
+			const int x = i % PARTICLES_PER_SIDE;
+			const int y = (i / PARTICLES_PER_SIDE) % PARTICLES_PER_SIDE;
+			const int z = i / (PARTICLES_PER_SIDE * PARTICLES_PER_SIDE);
+
+			Vec position = START + SPACING * Vec(x, y, z);
+			for (int axis = 0; axis < 3; ++axis)
+				position[axis] += ((NextJitter(jitter) % 100) / 100.0f) * 0.005f;
+
+			particles.position[i] = position;
+		}
+		UpdateSpatialHashGrid(UpdateParams());
+
+		if (!createGpuBuffers)
+			return;
+
+		GLCall(GL_PROGRAM_POINT_SIZE);
+		GLCall(glEnable(GL_BLEND));
+		GLCall(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
+
+		m_Shader = std::make_unique<Shader>("res/shaders/Fluid3D.shader");
+		m_VAO = std::make_unique<VertexArray>();
+
+		m_VertexBuffer = std::make_unique<VertexBuffer>(nullptr, 2 * sizeof(Vec) * NO_OF_PARTICLES);
+		VertexBufferLayout layout;
+		layout.Push<float>(3);	// Position
+		layout.Push<float>(3);	// Velocity
+
+		m_VAO->AddPlanarBuffer(*m_VertexBuffer, layout, NO_OF_PARTICLES);
+		m_Shader->Bind();
+	}
+
+	FluidSim3D::~FluidSim3D() {}
+
+	/*
+		Calls func(j) for every particle j in the 27 cells around position. Rows of the
+		stencil are contiguous in SortedIndices(), see DenseGridLayout.
+	*/
+	template <typename Func>
+	void FluidSim3D::ForEachNeighbourCandidate(const Vec& position, Func&& func) const
+	{
+		const std::vector<int>& sorted = grid.SortedIndices();
+		const glm::ivec3 coord = GetCellCoord(position, Simulation3DConstants::DOMAIN_MIN, gridCellSize);
+		gridLayout.ForEachRow(coord, 1, [&](int first_cell, int last_cell) {
+			const int end = grid.CellStart(last_cell) + grid.CellCount(last_cell);
+			for (int k = grid.CellStart(first_cell); k < end; ++k) {
+				func(sorted[k]);
+			}
+		});
+	}
+
+	void FluidSim3D::UpdateSpatialHashGrid(const Params& params)
+	{
+		gridCellSize = params.grid_cell_size;
+		gridLayout.width = params.grid_width;
+
+		Utils::ParallelFor(0, particles.Size(), Utils::DEFAULT_GRAIN,
+			[&](int i) {
+				cellKeys[i] = gridLayout.Key(GetCellCoord(particles.position[i], Simulation3DConstants::DOMAIN_MIN, gridCellSize));
+			}
+		);
+		grid.Build(cellKeys, gridLayout.CellCount());
+	}
+
+	/*
+		Runs pass with a copy of the kernel the settings select, so each pass is compiled
+		once per shape with the kernel inlined into its pair loop.
+	*/
+	template <typename Pass>
+	void FluidSim3D::WithKernel(const Params& params, Pass&& pass)
+	{
+		switch (params.settings.kernel_shape) {
+		case KernelShape::CubicSpline:
+			pass(CubicSplineKernel<float, 3>(params.kernels.Get<CubicSplineKernel<float, 3>>()));
+			break;
+		case KernelShape::WendlandC2:
+			pass(WendlandC2Kernel<float, 3>(params.kernels.Get<WendlandC2Kernel<float, 3>>()));
+			break;
+		case KernelShape::WendlandC4:
+			pass(WendlandC4Kernel<float, 3>(params.kernels.Get<WendlandC4Kernel<float, 3>>()));
+			break;
+		default:
+			pass(Poly6SpikyKernel<float, 3>(params.kernels.Get<Poly6SpikyKernel<float, 3>>()));
+			break;
+		}
+	}
+
+	void FluidSim3D::UpdateParticleDensity(const Params& params)
+	{
+		WithKernel(params, [&](const auto& kernel) { UpdateParticleDensity(params, kernel); });
+	}
+
+	template <typename Kernel>
+	void FluidSim3D::UpdateParticleDensity(const Params& params, const Kernel& kernel)
+	{
+		const float R2 = params.R2;
+		const float mass = params.mass;
+
+		Utils::ParallelFor(0, particles.Size(), Utils::DEFAULT_GRAIN,
+			[&](int i) {
+				const Vec position = particles.position[i];
+				float density = 0.0f;
+
+				ForEachNeighbourCandidate(position, [&](int j) {
+					const Vec diff = position - particles.position[j];
+					const float dist2 = glm::dot(diff, diff);
+
+					if (R2 > dist2) {
+						density += mass * kernel.Density(dist2);
+					}
+				});
+				particles.density[i] = density;
+			}
+		);
+	}
+
+	void FluidSim3D::UpdateParticlePressure(const Params& params)
+	{
+		const float rest_density = params.rest_density;
+		const float gas_constant = params.gas_constant;
+		Utils::ParallelFor(0, particles.Size(), Utils::DEFAULT_GRAIN,
+			[&](int i) {
+				particles.pressure[i] = TaitPressure(particles.density[i], rest_density, gas_constant);
+			}
+		);
+	}
+
+	void FluidSim3D::ComputeForces(const Params& params)
+	{
+		WithKernel(params, [&](const auto& kernel) { ComputeForces(params, kernel); });
+	}
+
+	template <typename Kernel>
+	void FluidSim3D::ComputeForces(const Params& params, const Kernel& kernel)
+	{
+		const float R2 = params.R2;
+		const float mass = params.mass;
+		const float viscosity = params.viscosity;
+
+		Utils::ParallelFor(0, particles.Size(), Utils::DEFAULT_GRAIN,
+			[&](int i) {
+				const Vec position = particles.position[i];
+				const Vec velocity = particles.velocity[i];
+				const float pressure = particles.pressure[i];
+				Vec f_pressure(0.0f);
+				Vec f_viscosity(0.0f);
+
+				ForEachNeighbourCandidate(position, [&](int j) {
+					if (j == i) return;
+
+					const Vec diff = position - particles.position[j];
+					const float dist2 = glm::dot(diff, diff);
+					if (dist2 >= R2 || dist2 <= 1e-6f) return;
+
+					const float r = std::sqrt(dist2);
+					const Vec kernel_gradient = kernel.Gradient(r) * (diff / r);
+
+					const float pressure_avg = 0.5f * (pressure + particles.pressure[j]) / particles.density[j];
+					f_pressure += -mass * pressure_avg * kernel_gradient;
+
+					const Vec v_rel = particles.velocity[j] - velocity;
+					f_viscosity += mass * (v_rel / particles.density[j]) * kernel.Laplacian(r);
+				});
+
+				particles.F_pressure[i] = f_pressure;
+				particles.F_viscosity[i] = viscosity * f_viscosity;
+			}
+		);
+	}
+
+	void FluidSim3D::Integrate(const Params& params)
+	{
+		const IntegrateConstants<float> integrate = params.integrate;
+
+		Utils::ParallelFor(0, particles.Size(), Utils::DEFAULT_GRAIN,
+			[&](int i) {
+				Vec F_total = particles.F_pressure[i];
+				if (integrate.terms & TERM_VISCOSITY)
+					F_total += particles.F_viscosity[i];
+				if (integrate.terms & TERM_GRAVITY)
+					F_total += GravityForce<3>(integrate);
+
+				const Vec acceleration = F_total / integrate.mass;
+				particles.cold.acceleration[i] = acceleration;
+				AdvanceParticle<ALL_FORCE_TERMS>(integrate, acceleration, particles.position[i], particles.velocity[i]);
+			}
+		);
+	}
+
+	const FluidSim3D::Params& FluidSim3D::UpdateParams()
+	{
+		using namespace Simulation3DConstants;
+		SimSettings settings;
+		settings.smoothing_radius = SMOOTHING_RADIUS;
+		settings.mass = MASS;
+		settings.rest_density = REST_DENSITY;
+		settings.viscosity = VISCOSITY_COEFFICIENT;
+		settings.gas_constant = GAS_CONSTANT;
+		settings.gravity = GRAVITY;
+		settings.kernel_shape = KERNEL_SHAPE;
+		settings.damping = DAMPENING;
+		settings.gpu_upload = m_VertexBuffer != nullptr;
+
+		if (!stepParamsValid || settings != stepParams.settings)
+			DeriveParams(settings);
+		return stepParams;
+	}
+
+	void FluidSim3D::DeriveParams(const SimSettings& settings)
+	{
+		Params& params = stepParams;
+
+		if (!stepParamsValid || settings.smoothing_radius != params.settings.smoothing_radius)
+			params.kernels = KernelSet<float, 3>(settings.smoothing_radius);
+		params.settings = settings;
+		stepParamsValid = true;
+
+		const float h = settings.smoothing_radius;
+		params.h = h;
+		params.R2 = h * h;
+		params.mass = settings.mass;
+		params.rest_density = settings.rest_density;
+		params.gas_constant = settings.gas_constant;
+		params.viscosity = settings.viscosity;
+		params.gravity = settings.gravity;
+		params.dt = GlobalConstants::DT;
+		params.max_speed = h * Simulation3DConstants::SAFETY_FACTOR / GlobalConstants::DT;
+		params.max_speed2 = params.max_speed * params.max_speed;
+
+		params.force_terms = TERM_WALLS;
+		if (settings.viscosity != 0.0f)
+			params.force_terms |= TERM_VISCOSITY;
+		if (settings.gravity != 0.0f)
+			params.force_terms |= TERM_GRAVITY;
+		if (settings.damping != 1.0f)
+			params.force_terms |= TERM_WALL_DAMPING;
+
+		IntegrateConstants<float>& constants = params.integrate;
+		constants.mass = params.mass;
+		constants.gravity = params.gravity;
+		constants.dt = params.dt;
+		constants.max_speed = params.max_speed;
+		constants.max_speed2 = params.max_speed2;
+		constants.damping = settings.damping;
+		constants.domain_min = Simulation3DConstants::DOMAIN_MIN;
+		constants.domain_max = Simulation3DConstants::DOMAIN_MAX;
+		constants.terms = params.force_terms;
+
+		params.grid_dense = true;
+		params.grid_cell_size = h;
+		const float domain_size = Simulation3DConstants::DOMAIN_MAX - Simulation3DConstants::DOMAIN_MIN;
+		params.grid_width = static_cast<int>(domain_size / h) + 1;
+	}
+
+	void FluidSim3D::OnUpdate()
+	{
+		const Params& params = UpdateParams();
+
+		UpdateSpatialHashGrid(params);
+		UpdateParticleDensity(params);
+		UpdateParticlePressure(params);
+		ComputeForces(params);
+		Integrate(params);
+
+		stepCount++;
+		if (!m_VertexBuffer)
+			return;
+
+		// Never reordered and stored as float, so the arrays upload as they are
+		const size_t block_size = particles.Size() * sizeof(Vec);
+		m_VertexBuffer->Bind();
+		GLCall(glBufferSubData(GL_ARRAY_BUFFER, 0, block_size, particles.position.data()));
+		GLCall(glBufferSubData(GL_ARRAY_BUFFER, block_size, block_size, particles.velocity.data()));
+	}
+
+	glm::mat4 FluidSim3D::GetViewProjection() const
+	{
+		const glm::vec3 eye = cameraDistance * glm::vec3(
+			std::cos(cameraPitch) * std::sin(cameraYaw),
+			std::sin(cameraPitch),
+			std::cos(cameraPitch) * std::cos(cameraYaw));
+
+		const float aspect = static_cast<float>(GlobalConstants::WINDOW_WIDTH) / GlobalConstants::WINDOW_HEIGHT;
+		const glm::mat4 proj = glm::perspective(glm::radians(45.0f), aspect, 0.1f, 20.0f);
+		const glm::mat4 view = glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		return proj * view;
+	}
+
+	void FluidSim3D::OnRender()
+	{
+		GLCall(glClearColor(0.0f, 0.0f, 0.0f, 1.0f));
+		GLCall(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+
+		m_Shader->Bind();
+		m_Shader->SetUniformMat4f("u_MVP", GetViewProjection());
+		m_Shader->SetUniform1f("u_PointScale", 0.03f * GlobalConstants::WINDOW_HEIGHT);
+
+		Renderer renderer;
+		renderer.DrawArraySphere(*m_VAO, *m_Shader, Simulation3DConstants::NO_OF_PARTICLES);
+	}
+
+	void FluidSim3D::OnImGuiRender()
+	{
+		float framerate = ImGui::GetIO().Framerate;
+		frame_buffer[array_offset] = framerate;
+
+		array_offset = (array_offset + 1) % frame_buffer.size();
+		ImGui::PlotLines("FPS",
+			frame_buffer.data(),
+			frame_buffer.size(),
+			array_offset,
+			NULL,
+			0.0f,
+			100.0f,
+			ImVec2(0, 80.0f)
+		);
+
+		ImGui::Text("Applicaton average %.3f ms/frame (%.1f FPS)", 1000.0f / framerate, framerate);
+		ImGui::Text("%d particles, %d cells of %.3f", particles.Size(), gridLayout.CellCount(), gridCellSize);
+		ImGui::Separator();
+
+		const char* kernel_shapes[KERNEL_SHAPE_COUNT];
+		for (int shape = 0; shape < KERNEL_SHAPE_COUNT; ++shape)
+			kernel_shapes[shape] = GetKernelShapeName(static_cast<KernelShape>(shape));
+		int kernel_shape = static_cast<int>(Simulation3DConstants::KERNEL_SHAPE);
+		if (ImGui::Combo("SPH Kernel", &kernel_shape, kernel_shapes, KERNEL_SHAPE_COUNT))
+			Simulation3DConstants::KERNEL_SHAPE = static_cast<KernelShape>(kernel_shape);
+
+		ImGui::SliderFloat("Density (kg/m^3)", &Simulation3DConstants::REST_DENSITY, 1000.0f, 12000.0f);
+		ImGui::SliderFloat("Viscosity (Pa*s)", &Simulation3DConstants::VISCOSITY_COEFFICIENT, 0.0f, 0.02f);
+		ImGui::SliderFloat("Gas Constant", &Simulation3DConstants::GAS_CONSTANT, 0.1f, 5.0f);
+		ImGui::SliderFloat("Gravity (m/s^2)", &Simulation3DConstants::GRAVITY, 0.0f, 25.0f);
+		ImGui::SliderFloat("Wall Damping", &Simulation3DConstants::DAMPENING, -1.0f, 1.0f);
+		ImGui::Separator();
+
+		ImGui::SliderAngle("Camera Yaw", &cameraYaw, -180.0f, 180.0f);
+		ImGui::SliderAngle("Camera Pitch", &cameraPitch, -85.0f, 85.0f);
+		ImGui::SliderFloat("Camera Distance", &cameraDistance, 2.0f, 8.0f);
+	}
+}
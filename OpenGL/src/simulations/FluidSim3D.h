@@ -0,0 +1,119 @@
+#pragma once
+
+#include "Simulation.h"
+#include "ParticleStore.h"
+#include "CellBinner.h"
+#include "SphKernels.h"
+#include "SphCore.h"
+#include "ForceTerms.h"
+#include "SimParams.h"
+#include "UniformGrid.h"
+#include "Utils.h"
+
+#include "VertexBuffer.h"
+#include "VertexBufferLayout.h"
+#include "Texture.h"
+
+#include <memory>
+#include <array>
+#include <vector>
+
+namespace Simulation3DConstants {
+	// A cube of PARTICLES_PER_SIDE^3 particles dropped into the corner of the box
+	static constexpr int PARTICLES_PER_SIDE = 16;
+	static constexpr int NO_OF_PARTICLES = PARTICLES_PER_SIDE * PARTICLES_PER_SIDE * PARTICLES_PER_SIDE;
+	static constexpr float SPACING = 0.05f;
+	static constexpr float START = -0.95f;
+
+	static constexpr float SAFETY_FACTOR = 0.40f;
+	static constexpr float DOMAIN_MIN = -1.0f;
+	static constexpr float DOMAIN_MAX = 1.0f;
+
+	inline static float SMOOTHING_RADIUS = 0.1f;
+	inline static float MASS = 1.0f;
+	inline static float REST_DENSITY = 7000.0f;
+	inline static float VISCOSITY_COEFFICIENT = 0.002f;
+	inline static float GAS_CONSTANT = 2.0f;
+	inline static float GRAVITY = 9.81f;
+	inline static float DAMPENING = -0.3f;
+
+	inline static simulation::KernelShape KERNEL_SHAPE = simulation::KernelShape::Poly6Spiky;
+}
+
+namespace simulation {
+	/*
+		Three dimensional solver on the same dimension-templated core as FluidSim2D: the
+		kernels with their 3D normalisation, the particle store, the dense grid walked
+		with its 27 cell stencil, Tait pressure and the integrator. It keeps to the plain
+		per-particle density and force passes in float; the 2D solver's traversal,
+		precision and approximation options are all written for vec2 and are not
+		available here, nor is the mouse.
+
+		Particles are drawn as points under a perspective camera orbiting the box.
+	*/
+	class FluidSim3D : public Simulation
+	{
+	public:
+		using Vec = glm::vec3;
+		using Params = SimParams<float, 3>;
+
+		FluidSim3D();
+		// Without GPU buffers the solver can be stepped off screen
+		explicit FluidSim3D(bool createGpuBuffers);
+		~FluidSim3D();
+
+		// Captures this step's SimParams, recomputing what depends on a changed setting
+		const Params& UpdateParams();
+
+		void UpdateSpatialHashGrid(const Params& params);
+		void UpdateParticleDensity(const Params& params);
+		void UpdateParticlePressure(const Params& params);
+		void ComputeForces(const Params& params);
+		void Integrate(const Params& params);
+
+		void OnUpdate() override;
+		void OnRender() override;
+		void OnImGuiRender() override;
+
+	private:
+		void DeriveParams(const SimSettings& settings);
+
+		template <typename Pass>
+		static void WithKernel(const Params& params, Pass&& pass);
+
+		template <typename Kernel>
+		void UpdateParticleDensity(const Params& params, const Kernel& kernel);
+		template <typename Kernel>
+		void ComputeForces(const Params& params, const Kernel& kernel);
+
+		template <typename Func>
+		void ForEachNeighbourCandidate(const Vec& position, Func&& func) const;
+
+		glm::mat4 GetViewProjection() const;
+
+		std::unique_ptr<VertexArray> m_VAO;
+		std::unique_ptr<VertexBuffer> m_VertexBuffer;
+		std::unique_ptr<Shader> m_Shader;
+
+		BasicParticleStore<float, float, 3> particles;
+		int stepCount = 0;
+
+		Params stepParams;
+		bool stepParamsValid = false;
+
+		CellBinner grid;
+		float gridCellSize = 0.0f;
+		DenseGridLayout<3> gridLayout;
+
+		// Orbit camera, angles in radians
+		float cameraYaw = 0.6f;
+		float cameraPitch = 0.35f;
+		float cameraDistance = 3.6f;
+
+		std::vector<int> cellKeys =
+			std::vector<int>(Simulation3DConstants::NO_OF_PARTICLES, 0);
+
+		std::array<float, 90> frame_buffer = {};
+		int array_offset = 0;
+	};
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <array>
+#include <utility>
+
+namespace simulation {
+	/*
+		Bitmask of the optional terms in the force and integrate passes. Those passes are
+		compiled once per combination with the mask as a template argument, so a disabled
+		term is removed from the inner loop rather than skipped at runtime.
+	*/
+	enum ForceTerm : unsigned {
+		TERM_VISCOSITY = 1u << 0,	// Viscous force between neighbours
+		TERM_EXTERNAL = 1u << 1,	// F_other, i.e. mouse interaction, cleared once applied
+		TERM_GRAVITY = 1u << 2,
+		TERM_WALLS = 1u << 3,		// Clamp to the domain bounds
+		TERM_WALL_DAMPING = 1u << 4	// Scale the velocity on wall contact
+	};
+
+	static constexpr unsigned FORCE_TERM_COMBINATIONS = 1u << 5;
+	static constexpr unsigned ALL_FORCE_TERMS = FORCE_TERM_COMBINATIONS - 1;
+
+	/*
+		Builds a table with one entry per term combination, entry k being
+		Factory::template Get<k>().
+	*/
+	template <typename Factory, unsigned... Terms>
+	constexpr auto MakeForceTermTable(std::integer_sequence<unsigned, Terms...>)
+	{
+		return std::array<decltype(Factory::template Get<0>()), sizeof...(Terms)>{ Factory::template Get<Terms>()... };
+	}
+
+	template <typename Factory>
+	constexpr auto MakeForceTermTable()
+	{
+		return MakeForceTermTable<Factory>(std::make_integer_sequence<unsigned, FORCE_TERM_COMBINATIONS>());
+	}
+}
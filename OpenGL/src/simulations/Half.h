@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace simulation {
+	/*
+		IEEE 754 binary16 storage type. Only used to hold particle state, every operation
+		converts to float first, so it behaves like a float rounded to 11 significant bits
+		(about 3 decimal digits) on every store.
+
+		Conversion is done with integer bit manipulation so it is identical on every
+		platform, including wasm. Stores round to nearest even, values beyond the half
+		range become infinity.
+	*/
+	struct Half
+	{
+		uint16_t bits;
+
+		Half() = default;
+		Half(float value) : bits(FromFloat(value)) {}
+
+		operator float() const { return ToFloat(bits); }
+
+		static inline uint16_t FromFloat(float value)
+		{
+			const uint32_t f32_infinity = 255u << 23;
+			const uint32_t f16_overflow = (127u + 16u) << 23;
+			const uint32_t denormal_magic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+
+			uint32_t f = BitCast<uint32_t>(value);
+			const uint32_t sign = f & 0x80000000u;
+			f ^= sign;
+
+			uint16_t result;
+			if (f >= f16_overflow) {
+				// Infinity stays infinity, NaN becomes a quiet NaN
+				result = f > f32_infinity ? 0x7E00 : 0x7C00;
+			} else if (f < (113u << 23)) {
+				// Denormal or zero: let the float adder do the rounding
+				const float shifted = BitCast<float>(f) + BitCast<float>(denormal_magic);
+				result = static_cast<uint16_t>(BitCast<uint32_t>(shifted) - denormal_magic);
+			} else {
+				const uint32_t mantissa_odd = (f >> 13) & 1u;
+				f += (static_cast<uint32_t>(15 - 127) << 23) + 0xFFFu;
+				f += mantissa_odd;
+				result = static_cast<uint16_t>(f >> 13);
+			}
+			return static_cast<uint16_t>(result | (sign >> 16));
+		}
+
+		static inline float ToFloat(uint16_t half)
+		{
+			const uint32_t magnitude = (half & 0x7FFFu) << 13;
+			const uint32_t sign = (half & 0x8000u) << 16;
+
+			// Rebias the exponent with one multiply, which also normalises denormals
+			float value = BitCast<float>(magnitude) * 5.192296858534828e+33f;	// 2^112
+			if (magnitude >= (0x7C00u << 13))
+				value = BitCast<float>(magnitude | (255u << 23));
+			return BitCast<float>(BitCast<uint32_t>(value) | sign);
+		}
+
+	private:
+		template <typename To, typename From>
+		static inline To BitCast(From from)
+		{
+			static_assert(sizeof(To) == sizeof(From), "BitCast needs equally sized types");
+			To to;
+			std::memcpy(&to, &from, sizeof(To));
+			return to;
+		}
+	};
+
+	static_assert(sizeof(Half) == 2, "Half must be two bytes");
+}
@@ -0,0 +1,87 @@
+#include "LoadBalancer.h"
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+namespace Utils {
+	void LoadBalancer::Resize(int count)
+	{
+		if (static_cast<int>(m_Costs.size()) != count)
+			m_Costs.assign(count, 1);
+	}
+
+	void LoadBalancer::Permute(const std::vector<int>& order)
+	{
+		if (m_Costs.size() != order.size())
+			return;
+		std::vector<int> permuted(order.size());
+		for (size_t k = 0; k < order.size(); ++k)
+			permuted[k] = m_Costs[order[k]];
+		m_Costs.swap(permuted);
+	}
+
+	void LoadBalancer::Partition(int count, int threadCount, bool useCosts)
+	{
+		const int blocks = (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+		const int chunks = std::max(1, std::min(blocks, threadCount * CHUNKS_PER_THREAD));
+		m_Bounds.resize(chunks + 1);
+		m_Bounds[0] = 0;
+		m_Bounds[chunks] = count;
+
+		if (!useCosts || !GetCosts(count)) {
+			for (int c = 1; c < chunks; ++c)
+				m_Bounds[c] = static_cast<int>(static_cast<long long>(count) * c / chunks);
+			return;
+		}
+
+		m_BlockPrefix.resize(blocks + 1);
+		ParallelFor(0, blocks, 16,
+			[&](int block) {
+				const int b = block * BLOCK_SIZE;
+				const int e = std::min(count, b + BLOCK_SIZE);
+				long long cost = 0;
+				for (int i = b; i < e; ++i)
+					cost += m_Costs[i];
+				m_BlockPrefix[block + 1] = cost;
+			}
+		);
+		m_BlockPrefix[0] = 0;
+		for (int block = 0; block < blocks; ++block)
+			m_BlockPrefix[block + 1] += m_BlockPrefix[block];
+
+		// Chunk c starts at the block boundary whose running total is closest to c / chunks of the whole
+		const long long total = m_BlockPrefix[blocks];
+		for (int c = 1; c < chunks; ++c) {
+			const long long target = total * c / chunks;
+			int block = static_cast<int>(std::lower_bound(m_BlockPrefix.begin(), m_BlockPrefix.end(), target) - m_BlockPrefix.begin());
+			if (block > 0 && target - m_BlockPrefix[block - 1] < m_BlockPrefix[block] - target)
+				block--;
+			m_Bounds[c] = std::min(count, std::max(m_Bounds[c - 1], block * BLOCK_SIZE));
+		}
+	}
+
+	void LoadBalancer::CollectBusy(ThreadBusy& busy) const
+	{
+		std::vector<std::pair<std::thread::id, double>> threads;
+		for (size_t chunk = 0; chunk < m_ChunkMs.size(); ++chunk) {
+			auto it = std::find_if(threads.begin(), threads.end(),
+				[&](const std::pair<std::thread::id, double>& thread) { return thread.first == m_ChunkThread[chunk]; });
+			if (it == threads.end())
+				threads.emplace_back(m_ChunkThread[chunk], m_ChunkMs[chunk]);
+			else
+				it->second += m_ChunkMs[chunk];
+		}
+
+		// Threads that took no chunk were idle for the whole loop
+		const int thread_count = std::max(GetParallelThreadCount(), static_cast<int>(threads.size()));
+		busy.ms.assign(thread_count, 0.0);
+		double total = 0.0;
+		for (size_t t = 0; t < threads.size(); ++t) {
+			busy.ms[t] = threads[t].second;
+			total += threads[t].second;
+		}
+		std::sort(busy.ms.begin(), busy.ms.end(), std::greater<double>());
+		busy.imbalance = total > 0.0 ? busy.ms[0] * thread_count / total : 1.0;
+	}
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "Utils.h"
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace Utils {
+	// Busy time of each thread over one loop
+	struct ThreadBusy
+	{
+		std::vector<double> ms;		// One per thread, busiest first, idle threads as 0
+		double imbalance = 1.0;		// Busiest thread over the mean of all threads
+	};
+
+	/*
+		Splits a loop over items of uneven cost into chunks of equal estimated cost.
+		Costs are given per item, usually measured by the previous run of the loop; they
+		are summed per BLOCK_SIZE items and the chunk bounds found by binary search in
+		the running total. Each thread gets CHUNKS_PER_THREAD chunks, so what the
+		estimate gets wrong is still evened out by the backend's scheduling. Without
+		costs the chunks hold equal item counts.
+	*/
+	class LoadBalancer
+	{
+	public:
+		static constexpr int BLOCK_SIZE = 16;
+		static constexpr int CHUNKS_PER_THREAD = 4;
+
+		// Makes room for the costs of count items, each 1 until it is measured
+		void Resize(int count);
+
+		// Moves the costs along with items reordered so that item k is the old item order[k]
+		void Permute(const std::vector<int>& order);
+
+		// Per item costs for the loop measuring them to write, or null unless sized for count items
+		inline int* GetCosts(int count) { return static_cast<int>(m_Costs.size()) == count ? m_Costs.data() : nullptr; }
+
+		// Chunks of equal cost, or of equal item count without useCosts, for threadCount threads
+		void Partition(int count, int threadCount, bool useCosts);
+
+		inline int GetChunkCount() const { return static_cast<int>(m_Bounds.size()) - 1; }
+
+		// Calls func(b, e) for every chunk in parallel and records how long each thread was busy
+		template <typename Func>
+		void Run(Func func, ThreadBusy& busy)
+		{
+			const int chunks = GetChunkCount();
+			m_ChunkThread.resize(chunks);
+			m_ChunkMs.resize(chunks);
+
+			ParallelFor(0, chunks, 1,
+				[&](int chunk) {
+					const auto start = std::chrono::steady_clock::now();
+					func(m_Bounds[chunk], m_Bounds[chunk + 1]);
+					m_ChunkMs[chunk] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+					m_ChunkThread[chunk] = std::this_thread::get_id();
+				}
+			);
+			CollectBusy(busy);
+		}
+
+	private:
+		void CollectBusy(ThreadBusy& busy) const;
+
+		std::vector<int> m_Costs;
+		// Running cost total at the start of each block, and the total at the end
+		std::vector<long long> m_BlockPrefix;
+		// Chunk c covers [m_Bounds[c], m_Bounds[c + 1])
+		std::vector<int> m_Bounds = std::vector<int>(1, 0);
+
+		std::vector<std::thread::id> m_ChunkThread;
+		std::vector<double> m_ChunkMs;
+	};
+}
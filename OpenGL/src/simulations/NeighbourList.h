@@ -0,0 +1,98 @@
+#pragma once
+
+#include "Utils.h"
+
+#include <vector>
+
+namespace simulation {
+	/*
+		Compressed sparse row neighbour storage. The entries of particle i live in
+		[offsets[i], offsets[i + 1]), so memory is bounded by the number of pairs
+		actually found rather than a fixed capacity per particle.
+	*/
+	template <typename Entry>
+	struct NeighbourList
+	{
+		std::vector<int> offsets;
+		std::vector<Entry> entries;
+
+		inline int Begin(int i) const { return offsets[i]; }
+		inline int End(int i) const { return offsets[i + 1]; }
+		inline int Size() const { return static_cast<int>(entries.size()); }
+
+		/*
+			Two pass parallel build: count(i) returns how many entries particle i has,
+			then fill(i, out) writes exactly that many entries starting at out.
+		*/
+		template <typename CountFunc, typename FillFunc>
+		void Build(int particle_count, CountFunc count, FillFunc fill, Utils::Grain grain = Utils::DEFAULT_GRAIN)
+		{
+			std::vector<int> counts(particle_count);
+			Utils::ParallelFor(0, particle_count, grain,
+				[&](int i) {
+					counts[i] = count(i);
+				}
+			);
+
+			offsets.resize(particle_count + 1);
+			Utils::ParallelScan(counts.begin(), counts.end(), offsets.begin(), 0);
+			offsets[particle_count] = particle_count > 0 ? offsets[particle_count - 1] + counts[particle_count - 1] : 0;
+
+			entries.resize(offsets[particle_count]);
+			Utils::ParallelFor(0, particle_count, grain,
+				[&](int i) {
+					fill(i, &entries[offsets[i]]);
+				}
+			);
+		}
+	};
+
+	template <typename T>
+	struct PairEntry
+	{
+		int neighbour;
+		T r;
+		T inv_r;
+	};
+
+	/*
+		Interacting pairs found during one step, with their distance already resolved.
+		Each particle reserves room for every candidate it could have, then records how
+		many were inside the smoothing radius, so the cache can be filled in the same
+		walk that finds the pairs. Valid until positions change. Distances are kept in
+		the solver's compute type T.
+	*/
+	template <typename T>
+	struct PairCache
+	{
+		std::vector<int> offsets;
+		std::vector<int> counts;
+		std::vector<PairEntry<T>> entries;
+		bool valid = false;
+
+		// Only pairs with neighbour > i were recorded
+		bool half = false;
+
+		inline int Begin(int i) const { return offsets[i]; }
+		inline int End(int i) const { return offsets[i] + counts[i]; }
+
+		// capacity(i) is an upper bound on the pairs particle i can record
+		template <typename CapacityFunc>
+		void Reserve(int particle_count, CapacityFunc capacity, Utils::Grain grain = Utils::DEFAULT_GRAIN)
+		{
+			counts.resize(particle_count);
+			Utils::ParallelFor(0, particle_count, grain,
+				[&](int i) {
+					counts[i] = capacity(i);
+				}
+			);
+
+			offsets.resize(particle_count + 1);
+			Utils::ParallelScan(counts.begin(), counts.end(), offsets.begin(), 0);
+			offsets[particle_count] = particle_count > 0 ? offsets[particle_count - 1] + counts[particle_count - 1] : 0;
+
+			if (static_cast<int>(entries.size()) < offsets[particle_count])
+				entries.resize(offsets[particle_count]);
+		}
+	};
+}
@@ -0,0 +1,196 @@
+#include "NumaTopology.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#if defined(_WIN32)
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <Windows.h>
+#elif defined(__linux__) && !defined(__EMSCRIPTEN__)
+	#include <sched.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
+#endif
+
+namespace Utils {
+#if defined(__linux__) && !defined(__EMSCRIPTEN__)
+	static constexpr int MPOL_MF_MOVE_PAGES = 1 << 1;	// MPOL_MF_MOVE from numaif.h
+
+	// move_pages without libnuma. Null nodes only reports where each page is.
+	static long MovePagesSyscall(unsigned long count, void** pages, const int* nodes, int* status)
+	{
+		return syscall(SYS_move_pages, 0, count, pages, nodes, status, MPOL_MF_MOVE_PAGES);
+	}
+
+	// "0-3,8-11" as 0, 1, 2, 3, 8, 9, 10, 11
+	static std::vector<int> ParseCpuList(const std::string& list)
+	{
+		std::vector<int> cpus;
+		std::stringstream stream(list);
+		std::string range;
+		while (std::getline(stream, range, ',')) {
+			if (range.empty() || range == "\n")
+				continue;
+			const size_t dash = range.find('-');
+			const int first = std::stoi(range.substr(0, dash));
+			const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+			for (int cpu = first; cpu <= last; ++cpu)
+				cpus.push_back(cpu);
+		}
+		return cpus;
+	}
+#endif
+
+	const NumaTopology& NumaTopology::Get()
+	{
+		static NumaTopology topology;
+		return topology;
+	}
+
+	NumaTopology::NumaTopology()
+	{
+#if defined(_WIN32)
+		ULONG highest = 0;
+		if (GetNumaHighestNodeNumber(&highest)) {
+			for (ULONG node = 0; node <= highest; ++node) {
+				ULONGLONG mask = 0;
+				if (!GetNumaNodeProcessorMask(static_cast<UCHAR>(node), &mask) || mask == 0)
+					continue;
+				std::vector<int> cpus;
+				for (int cpu = 0; cpu < 64; ++cpu) {
+					if (mask & (1ull << cpu))
+						cpus.push_back(cpu);
+				}
+				m_NodeIds.push_back(static_cast<int>(node));
+				m_NodeCpus.push_back(cpus);
+			}
+		}
+#elif defined(__linux__) && !defined(__EMSCRIPTEN__)
+		// Node numbers can have gaps, so probe past the first missing one
+		for (int node = 0, missing = 0; missing < 64; ++node) {
+			std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+			std::string list;
+			if (!file || !std::getline(file, list)) {
+				missing++;
+				continue;
+			}
+			const std::vector<int> cpus = ParseCpuList(list);
+			if (!cpus.empty()) {
+				m_NodeIds.push_back(node);
+				m_NodeCpus.push_back(cpus);
+			}
+		}
+#endif
+		if (m_NodeCpus.empty()) {
+			const int cores = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+			m_NodeIds.assign(1, 0);
+			m_NodeCpus.emplace_back();
+			for (int cpu = 0; cpu < cores; ++cpu)
+				m_NodeCpus[0].push_back(cpu);
+		}
+
+		for (int node = 0; node < GetNodeCount(); ++node) {
+			for (int cpu : m_NodeCpus[node]) {
+				m_CpuOrder.push_back(cpu);
+				if (cpu >= static_cast<int>(m_CpuNode.size()))
+					m_CpuNode.resize(cpu + 1, 0);
+				m_CpuNode[cpu] = node;
+			}
+		}
+	}
+
+	int NumaTopology::GetCpuNode(int cpu) const
+	{
+		return cpu >= 0 && cpu < static_cast<int>(m_CpuNode.size()) ? m_CpuNode[cpu] : 0;
+	}
+
+	int NumaTopology::NodeIndex(int osNode) const
+	{
+		const auto it = std::find(m_NodeIds.begin(), m_NodeIds.end(), osNode);
+		return it == m_NodeIds.end() ? -1 : static_cast<int>(it - m_NodeIds.begin());
+	}
+
+	int NumaTopology::GetCurrentNode() const
+	{
+#if defined(_WIN32)
+		return GetCpuNode(static_cast<int>(GetCurrentProcessorNumber()));
+#elif defined(__linux__) && !defined(__EMSCRIPTEN__)
+		return GetCpuNode(sched_getcpu());
+#else
+		return 0;
+#endif
+	}
+
+	std::size_t NumaTopology::PageSize()
+	{
+#if defined(_WIN32)
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return info.dwPageSize;
+#elif defined(__linux__) && !defined(__EMSCRIPTEN__)
+		return static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#else
+		return 4096;
+#endif
+	}
+
+	int NumaTopology::MovePages(std::vector<void*>& pages, const std::vector<int>& nodes) const
+	{
+#if defined(__linux__) && !defined(__EMSCRIPTEN__)
+		if (pages.empty() || GetNodeCount() < 2)
+			return 0;
+
+		// Only the pages on the wrong node are moved
+		std::vector<int> status = PageNodes(pages);
+		std::vector<void*> misplaced;
+		std::vector<int> targets;
+		for (size_t p = 0; p < pages.size(); ++p) {
+			if (nodes[p] >= 0 && status[p] != nodes[p]) {
+				misplaced.push_back(pages[p]);
+				targets.push_back(m_NodeIds[nodes[p]]);
+			}
+		}
+		if (!misplaced.empty())
+			MovePagesSyscall(misplaced.size(), misplaced.data(), targets.data(), status.data());
+		return static_cast<int>(misplaced.size());
+#else
+		(void)pages;
+		(void)nodes;
+		return 0;
+#endif
+	}
+
+	std::vector<int> NumaTopology::PageNodes(std::vector<void*>& pages) const
+	{
+		std::vector<int> nodes(pages.size(), 0);
+#if defined(__linux__) && !defined(__EMSCRIPTEN__)
+		if (!pages.empty() && MovePagesSyscall(pages.size(), pages.data(), nullptr, nodes.data()) != 0)
+			std::fill(nodes.begin(), nodes.end(), -1);
+		// Pages not yet touched report an error instead of a node
+		for (int& node : nodes)
+			node = node < 0 ? -1 : NodeIndex(node);
+#endif
+		return nodes;
+	}
+
+	NumaHintFaults NumaTopology::ReadHintFaults()
+	{
+		NumaHintFaults faults;
+#if defined(__linux__) && !defined(__EMSCRIPTEN__)
+		std::ifstream file("/proc/vmstat");
+		std::string name;
+		long long value;
+		while (file >> name >> value) {
+			if (name == "numa_hint_faults")
+				faults.faults = value;
+			else if (name == "numa_hint_faults_local")
+				faults.local = value;
+		}
+#endif
+		return faults;
+	}
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace Utils {
+	/*
+		NUMA hinting faults since boot, from /proc/vmstat. With automatic NUMA balancing
+		on (kernel.numa_balancing = 1) the kernel samples page accesses by unmapping
+		pages now and then; each fault records whether the faulting thread ran on the
+		page's node, so the two counts estimate local and remote accesses. Both stay at
+		0 with balancing off.
+	*/
+	struct NumaHintFaults
+	{
+		long long faults = 0;
+		long long local = 0;
+	};
+
+	/*
+		The machine's NUMA nodes and the CPUs of each, read once. Linux reads them from
+		sysfs and Windows from the NUMA API; anything else, and a machine without NUMA,
+		is one node holding every CPU.
+
+		Pages are placed and queried with move_pages on Linux only. Elsewhere placement
+		does nothing and every page is reported on node 0.
+	*/
+	class NumaTopology
+	{
+	public:
+		static const NumaTopology& Get();
+
+		inline int GetNodeCount() const { return static_cast<int>(m_NodeCpus.size()); }
+		inline const std::vector<int>& GetNodeCpus(int node) const { return m_NodeCpus[node]; }
+
+		// Every CPU, those of node 0 first, then node 1's and so on
+		inline const std::vector<int>& GetCpuOrder() const { return m_CpuOrder; }
+		int GetCpuNode(int cpu) const;
+
+		// Node of the CPU the calling thread is running on
+		int GetCurrentNode() const;
+
+		/*
+			Moves the pages of [data, data + bytes) so that each lies on the node
+			nodeOf(offset) gives for the first byte of the page inside the range, or
+			leaves it where it is when that is -1. Pages shared with memory outside the
+			range are left alone. Returns the number of pages that were on another node.
+		*/
+		template <typename NodeOf>
+		int PlacePages(const void* data, std::size_t bytes, NodeOf nodeOf) const
+		{
+			std::vector<void*> pages;
+			std::vector<int> nodes;
+			CollectPages(data, bytes, pages, [&](std::size_t offset) { nodes.push_back(nodeOf(offset)); });
+			return MovePages(pages, nodes);
+		}
+
+		// Adds the pages PlacePages would look at to pages and returns how many lie on another node
+		template <typename NodeOf>
+		int CountMisplacedPages(const void* data, std::size_t bytes, NodeOf nodeOf, int& pages) const
+		{
+			std::vector<void*> addresses;
+			std::vector<int> nodes;
+			CollectPages(data, bytes, addresses, [&](std::size_t offset) { nodes.push_back(nodeOf(offset)); });
+			pages += static_cast<int>(addresses.size());
+
+			const std::vector<int> current = PageNodes(addresses);
+			int misplaced = 0;
+			for (size_t p = 0; p < addresses.size(); ++p)
+				misplaced += current[p] >= 0 && nodes[p] >= 0 && current[p] != nodes[p];
+			return misplaced;
+		}
+
+		// All 0 where /proc/vmstat cannot be read
+		static NumaHintFaults ReadHintFaults();
+
+	private:
+		NumaTopology();
+
+		template <typename OnPage>
+		static void CollectPages(const void* data, std::size_t bytes, std::vector<void*>& pages, OnPage onPage)
+		{
+			const std::size_t page = PageSize();
+			const std::size_t begin = reinterpret_cast<std::size_t>(data);
+			for (std::size_t address = (begin + page - 1) / page * page; address + page <= begin + bytes; address += page) {
+				pages.push_back(reinterpret_cast<void*>(address));
+				onPage(address - begin);
+			}
+		}
+
+		static std::size_t PageSize();
+		int MovePages(std::vector<void*>& pages, const std::vector<int>& nodes) const;
+		// Node each page lies on, -1 where it has none yet
+		std::vector<int> PageNodes(std::vector<void*>& pages) const;
+
+		int NodeIndex(int osNode) const;
+
+		// Indices here are dense, m_NodeIds holds the operating system's number of each node
+		std::vector<int> m_NodeIds;
+		std::vector<std::vector<int>> m_NodeCpus;
+		std::vector<int> m_CpuOrder;
+		std::vector<int> m_CpuNode;
+	};
+}
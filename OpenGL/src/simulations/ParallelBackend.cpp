@@ -0,0 +1,164 @@
+#include "ParallelBackend.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+#ifdef _OPENMP
+	#include <omp.h>
+#endif
+
+#ifdef SIM_WITH_TBB
+	#include <tbb/blocked_range.h>
+	#include <tbb/global_control.h>
+	#include <tbb/parallel_for.h>
+#endif
+
+namespace Utils {
+	static std::atomic<ParallelBackend> s_Backend{ DefaultParallelBackend() };
+	static std::atomic<int> s_ThreadCount{ ThreadPool::DefaultWorkerCount() + 1 };
+
+#ifdef SIM_WITH_TBB
+	// Caps TBB's arena at the chosen thread count while it is alive
+	static std::unique_ptr<tbb::global_control> s_TbbControl;
+#endif
+
+	static const char* const BACKEND_NAMES[PARALLEL_BACKEND_COUNT] = { "Serial", "Thread Pool", "OpenMP", "TBB" };
+	static const char* const BACKEND_KEYS[PARALLEL_BACKEND_COUNT] = { "serial", "threadpool", "openmp", "tbb" };
+
+	const char* GetParallelBackendName(ParallelBackend backend)
+	{
+		return BACKEND_NAMES[static_cast<int>(backend)];
+	}
+
+	bool IsParallelBackendAvailable(ParallelBackend backend)
+	{
+		switch (backend) {
+		case ParallelBackend::Serial:
+			return true;
+		case ParallelBackend::ThreadPool:
+#ifdef __EMSCRIPTEN__
+			return false;
+#else
+			return true;
+#endif
+		case ParallelBackend::OpenMP:
+#ifdef _OPENMP
+			return true;
+#else
+			return false;
+#endif
+		case ParallelBackend::TBB:
+#ifdef SIM_WITH_TBB
+			return true;
+#else
+			return false;
+#endif
+		}
+		return false;
+	}
+
+	ParallelBackend DefaultParallelBackend()
+	{
+#ifdef __EMSCRIPTEN__
+		return ParallelBackend::Serial;
+#else
+		if (const char* name = std::getenv("FLUID_PARALLEL_BACKEND")) {
+			for (int b = 0; b < PARALLEL_BACKEND_COUNT; ++b) {
+				const ParallelBackend backend = static_cast<ParallelBackend>(b);
+				if (std::strcmp(name, BACKEND_KEYS[b]) == 0 && IsParallelBackendAvailable(backend))
+					return backend;
+			}
+		}
+		return ParallelBackend::ThreadPool;
+#endif
+	}
+
+	void SetParallelBackend(ParallelBackend backend, int threadCount)
+	{
+		if (!IsParallelBackendAvailable(backend))
+			backend = DefaultParallelBackend();
+		threadCount = std::max(1, threadCount);
+
+#ifdef SIM_WITH_TBB
+		if (backend == ParallelBackend::TBB)
+			s_TbbControl = std::make_unique<tbb::global_control>(tbb::global_control::max_allowed_parallelism, threadCount);
+		else
+			s_TbbControl.reset();
+#endif
+
+		s_ThreadCount.store(threadCount, std::memory_order_relaxed);
+		s_Backend.store(backend, std::memory_order_relaxed);
+	}
+
+	ParallelBackend GetParallelBackend()
+	{
+		return s_Backend.load(std::memory_order_relaxed);
+	}
+
+	int GetParallelThreadCount()
+	{
+		switch (GetParallelBackend()) {
+		case ParallelBackend::Serial:
+			return 1;
+		case ParallelBackend::ThreadPool:
+			return ThreadPool::Get().GetThreadCount();
+		default:
+			return s_ThreadCount.load(std::memory_order_relaxed);
+		}
+	}
+
+	void RunParallel(int begin, int end, int grain, ThreadPool::RangeFunc func, void* context)
+	{
+		const int count = end - begin;
+		if (count <= 0)
+			return;
+
+		grain = std::max(1, grain);
+		switch (GetParallelBackend()) {
+		case ParallelBackend::Serial:
+			func(context, begin, end);
+			return;
+
+		case ParallelBackend::ThreadPool:
+			ThreadPool::Get().Run(begin, end, grain, func, context);
+			return;
+
+		case ParallelBackend::OpenMP:
+#ifdef _OPENMP
+		{
+			// Loops nested in a parallel region run inline, as they do on the pool
+			const int chunks = (count + grain - 1) / grain;
+			if (chunks == 1 || omp_in_parallel()) {
+				func(context, begin, end);
+				return;
+			}
+
+			#pragma omp parallel for schedule(dynamic, 1) num_threads(s_ThreadCount.load(std::memory_order_relaxed))
+			for (int chunk = 0; chunk < chunks; ++chunk) {
+				const int b = begin + chunk * grain;
+				func(context, b, std::min(end, b + grain));
+			}
+			return;
+		}
+#else
+			break;
+#endif
+
+		case ParallelBackend::TBB:
+#ifdef SIM_WITH_TBB
+			// The simple partitioner splits down to the grain, like the pool
+			tbb::parallel_for(tbb::blocked_range<int>(begin, end, grain),
+				[&](const tbb::blocked_range<int>& range) { func(context, range.begin(), range.end()); },
+				tbb::simple_partitioner());
+			return;
+#else
+			break;
+#endif
+		}
+
+		ThreadPool::Get().Run(begin, end, grain, func, context);
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "ThreadPool.h"
+
+namespace Utils {
+	/*
+		What Utils::ParallelFor and the other loops in Utils.h run on. The standard
+		library's parallel algorithms cannot be relied on for this: libstdc++ runs
+		par_unseq serially unless TBB is linked, without saying so. The backend is
+		instead picked at runtime from those compiled in:
+
+		Serial      every loop inline on the caller
+		ThreadPool  the work-stealing Utils::ThreadPool, always available
+		OpenMP      a dynamically scheduled omp parallel for, when built with /openmp or -fopenmp
+		TBB         tbb::parallel_for, when built with SIM_WITH_TBB defined and TBB linked
+
+		The wasm build has no threads and only offers Serial.
+	*/
+	enum class ParallelBackend { Serial, ThreadPool, OpenMP, TBB };
+	static constexpr int PARALLEL_BACKEND_COUNT = 4;
+
+	const char* GetParallelBackendName(ParallelBackend backend);
+	bool IsParallelBackendAvailable(ParallelBackend backend);
+
+	/*
+		Backend at startup: the one named by the FLUID_PARALLEL_BACKEND environment
+		variable (serial, threadpool, openmp or tbb) if it is available, otherwise the
+		thread pool, or Serial in the wasm build.
+	*/
+	ParallelBackend DefaultParallelBackend();
+
+	/*
+		Runs later loops on backend with threadCount threads, the caller included. The
+		thread pool is sized by ThreadPool::Resize() instead, so pinning stays with it.
+		An unavailable backend falls back to DefaultParallelBackend().
+	*/
+	void SetParallelBackend(ParallelBackend backend, int threadCount);
+	ParallelBackend GetParallelBackend();
+
+	// Threads the current backend runs a loop on, the caller included
+	int GetParallelThreadCount();
+
+	// Calls func(context, b, e) over disjoint ranges covering [begin, end), each at most grain long
+	void RunParallel(int begin, int end, int grain, ThreadPool::RangeFunc func, void* context);
+
+	template <typename Func>
+	void RunParallel(int begin, int end, int grain, Func& func)
+	{
+		RunParallel(begin, end, grain,
+			[](void* context, int b, int e) { (*static_cast<Func*>(context))(b, e); },
+			&func);
+	}
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include <vector>
+#include <new>
+#include <cstddef>
+
+namespace simulation {
+	/*
+		Allocator that hands out blocks aligned to a cache line, so every particle array
+		starts on a 64-byte boundary and 128/256-bit loads never split a line at index 0.
+	*/
+	template <typename T, std::size_t Alignment = 64>
+	struct AlignedAllocator
+	{
+		using value_type = T;
+
+		template <typename U>
+		struct rebind { using other = AlignedAllocator<U, Alignment>; };
+
+		AlignedAllocator() noexcept {}
+		template <typename U>
+		AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept {}
+
+		T* allocate(std::size_t n)
+		{
+			return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+		}
+
+		void deallocate(T* p, std::size_t) noexcept
+		{
+			::operator delete(p, std::align_val_t(Alignment));
+		}
+
+		template <typename U>
+		bool operator==(const AlignedAllocator<U, Alignment>&) const noexcept { return true; }
+		template <typename U>
+		bool operator!=(const AlignedAllocator<U, Alignment>&) const noexcept { return false; }
+	};
+
+	template <typename T>
+	using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+	/*
+		Structure of Arrays particle storage. Each field lives in its own contiguous,
+		aligned array so a pass only streams the bytes it actually reads.
+
+		Hot fields are read per neighbour inside the density and force loops. Cold fields
+		are touched at most once per particle per step and are kept out of those loops.
+
+		Only the hot fields use the Storage type, since they are what the neighbour loops
+		stream. Forces are written once and read once per step, so they stay in the
+		Compute type. Dim is 2 for FluidSim2D and 3 for FluidSim3D.
+	*/
+	template <typename Storage, typename Compute = Storage, int Dim = 2>
+	struct BasicParticleStore
+	{
+		using StorageVec = glm::vec<Dim, Storage>;
+		using Vec = glm::vec<Dim, Compute>;
+
+		// Hot: read for every neighbour
+		AlignedVector<StorageVec> position;
+		AlignedVector<StorageVec> velocity;
+		AlignedVector<Storage> density;
+		AlignedVector<Storage> pressure;
+
+		// Back buffers for passes that integrate a particle while its neighbours still
+		// read the current state. Only ever written before being read, so Permute skips them.
+		AlignedVector<StorageVec> next_position;
+		AlignedVector<StorageVec> next_velocity;
+
+		// Written once per particle by the force pass
+		AlignedVector<Vec> F_pressure;
+		AlignedVector<Vec> F_viscosity;
+
+		// Cold: interaction and debug data
+		struct Cold {
+			AlignedVector<Vec> acceleration;
+			AlignedVector<Vec> F_other;		// Zeroed by the integration that applies it
+			AlignedVector<glm::vec3> colour;
+		} cold;
+
+		// Stable external id of the particle in each slot, and the slot of each id
+		AlignedVector<int> id;
+		AlignedVector<int> slot;
+
+		void Resize(std::size_t count)
+		{
+			position.resize(count, StorageVec(Storage(0.0f)));
+			velocity.resize(count, StorageVec(Storage(0.0f)));
+			density.resize(count, Storage(0.0f));
+			pressure.resize(count, Storage(0.0f));
+			next_position.resize(count, StorageVec(Storage(0.0f)));
+			next_velocity.resize(count, StorageVec(Storage(0.0f)));
+
+			F_pressure.resize(count, Vec(0.0f));
+			F_viscosity.resize(count, Vec(0.0f));
+
+			cold.acceleration.resize(count, Vec(0.0f));
+			cold.F_other.resize(count, Vec(0.0f));
+			cold.colour.resize(count, glm::vec3(0.0f));
+
+			id.resize(count);
+			slot.resize(count);
+			for (std::size_t i = 0; i < count; ++i) {
+				id[i] = static_cast<int>(i);
+				slot[i] = static_cast<int>(i);
+			}
+		}
+
+		/*
+			Reorders every array so that slot k holds what was in slot order[k]. External
+			ids travel with their particle, so anything addressed by id is unaffected.
+		*/
+		void Permute(const std::vector<int>& order)
+		{
+			PermuteArray(position, order);
+			PermuteArray(velocity, order);
+			PermuteArray(density, order);
+			PermuteArray(pressure, order);
+
+			PermuteArray(F_pressure, order);
+			PermuteArray(F_viscosity, order);
+
+			PermuteArray(cold.acceleration, order);
+			PermuteArray(cold.F_other, order);
+			PermuteArray(cold.colour, order);
+
+			PermuteArray(id, order);
+			for (std::size_t k = 0; k < id.size(); ++k) {
+				slot[id[k]] = static_cast<int>(k);
+			}
+		}
+
+		// Writes `src` (in slot order) to `dst` in external id order, converting to U
+		template <typename T, typename U>
+		void ToExternalOrder(const AlignedVector<T>& src, AlignedVector<U>& dst) const
+		{
+			dst.resize(src.size());
+			for (std::size_t k = 0; k < src.size(); ++k) {
+				dst[id[k]] = U(src[k]);
+			}
+		}
+
+		// Makes the back buffers current once every particle has been integrated into them
+		void SwapStateBuffers()
+		{
+			position.swap(next_position);
+			velocity.swap(next_velocity);
+		}
+
+		inline int Size() const { return static_cast<int>(position.size()); }
+
+		// Calls func(array) for every per-particle array
+		template <typename Func>
+		void ForEachArray(Func func)
+		{
+			func(position);
+			func(velocity);
+			func(density);
+			func(pressure);
+			func(next_position);
+			func(next_velocity);
+			func(F_pressure);
+			func(F_viscosity);
+			func(cold.acceleration);
+			func(cold.F_other);
+			func(cold.colour);
+			func(id);
+			func(slot);
+		}
+
+	private:
+		template <typename T>
+		static void PermuteArray(AlignedVector<T>& array, const std::vector<int>& order)
+		{
+			AlignedVector<T> permuted(array.size());
+			for (std::size_t k = 0; k < order.size(); ++k) {
+				permuted[k] = array[order[k]];
+			}
+			array.swap(permuted);
+		}
+	};
+
+	using ParticleStore = BasicParticleStore<float>;
+}
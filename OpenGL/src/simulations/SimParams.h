@@ -0,0 +1,181 @@
+#pragma once
+
+#include "SphKernels.h"
+#include "SimdKernels.h"
+#include "ClusterPairList.h"
+#include "SphCore.h"
+#include "ParallelBackend.h"
+
+#include "glm/glm.hpp"
+
+#include <tuple>
+
+namespace simulation {
+	// Space-filling curve particles are reordered along
+	enum class ReorderCurve { Morton, Hilbert };
+
+	// Neighbour traversal a step runs the density and force passes with
+	enum class Traversal { AllPairs, PerParticle, CellTiles, ClusterPairs };
+
+	/*
+		How the per-particle density and force passes are split between threads: by the
+		grain with work stealing, into equal count chunks, or into chunks of equal
+		neighbour candidate count, see Utils::LoadBalancer
+	*/
+	enum class LoadBalance { Off, Uniform, CostModel };
+
+	/*
+		Every input of a step that can change between steps: the PhysicsConstants and
+		SimulationConstants the UI edits, the solver's SIMD level, whether it has a GPU
+		buffer to fill and whether the mouse is held down. Compared as a whole to decide
+		whether anything derived from it has to be recomputed.
+	*/
+	struct SimSettings
+	{
+		float smoothing_radius = 0.0f;
+		float mass = 0.0f;
+		float rest_density = 0.0f;
+		float viscosity = 0.0f;
+		float gas_constant = 0.0f;
+		float gravity = 0.0f;
+		KernelShape kernel_shape = KernelShape::Poly6Spiky;
+
+		float damping = 0.0f;
+		float grab_radius = 0.0f;
+		float grab_strength = 0.0f;
+		bool grabbing = false;
+
+		bool spatial_hashing = true;
+		bool dense_grid = true;
+		bool open_domain = false;
+		ReorderCurve reorder_curve = ReorderCurve::Hilbert;
+		int reorder_interval = 0;
+		bool verlet_lists = false;
+		float verlet_skin = 0.0f;
+		bool pair_cache = false;
+		bool symmetric_forces = false;
+		bool cluster_pairs = false;
+		int cluster_size = 4;
+		bool cell_tiles = false;
+		bool compress_neighbour_state = false;
+		bool deterministic = false;
+		bool fast_math = false;
+		bool collect_grid_stats = false;
+		bool fused_passes = false;
+		bool task_graph = false;
+		LoadBalance load_balance = LoadBalance::Off;
+		SimdLevel simd_level = SimdLevel::Scalar;
+		bool gpu_upload = false;
+		Utils::ParallelBackend parallel_backend = Utils::ParallelBackend::ThreadPool;
+		int worker_threads = 0;
+		bool pin_workers = false;
+		bool numa_aware = false;
+		int grain_size = 64;
+		bool auto_grain = false;
+
+		auto Tie() const
+		{
+			return std::tie(smoothing_radius, mass, rest_density, viscosity, gas_constant, gravity, kernel_shape,
+				damping, grab_radius, grab_strength, grabbing,
+				spatial_hashing, dense_grid, open_domain, reorder_curve, reorder_interval, verlet_lists, verlet_skin,
+				pair_cache, symmetric_forces, cluster_pairs, cluster_size, cell_tiles, compress_neighbour_state,
+				deterministic, fast_math, collect_grid_stats, fused_passes, task_graph, load_balance, simd_level, gpu_upload,
+				parallel_backend, worker_threads, pin_workers, numa_aware, grain_size, auto_grain);
+		}
+
+		bool operator==(const SimSettings& other) const { return Tie() == other.Tie(); }
+		bool operator!=(const SimSettings& other) const { return !(*this == other); }
+	};
+
+	/*
+		One instance of every kernel policy, exact and tabulated, for one smoothing
+		radius and dimension. Passes look theirs up by type.
+	*/
+	template <typename T, int Dim = 2>
+	class KernelSet
+	{
+	public:
+		explicit KernelSet(T h)
+			: m_Kernels(Poly6SpikyKernel<T, Dim>(h), CubicSplineKernel<T, Dim>(h), WendlandC2Kernel<T, Dim>(h), WendlandC4Kernel<T, Dim>(h),
+				TabulatedKernel<Poly6SpikyKernel<T, Dim>>(h), TabulatedKernel<CubicSplineKernel<T, Dim>>(h),
+				TabulatedKernel<WendlandC2Kernel<T, Dim>>(h), TabulatedKernel<WendlandC4Kernel<T, Dim>>(h))
+		{
+		}
+
+		template <typename Kernel>
+		const Kernel& Get() const { return std::get<Kernel>(m_Kernels); }
+
+	private:
+		std::tuple<Poly6SpikyKernel<T, Dim>, CubicSplineKernel<T, Dim>, WendlandC2Kernel<T, Dim>, WendlandC4Kernel<T, Dim>,
+			TabulatedKernel<Poly6SpikyKernel<T, Dim>>, TabulatedKernel<CubicSplineKernel<T, Dim>>,
+			TabulatedKernel<WendlandC2Kernel<T, Dim>>, TabulatedKernel<WendlandC4Kernel<T, Dim>>> m_Kernels;
+	};
+
+	/*
+		Read-only snapshot of the settings for one step, with everything derived from
+		them. The solver captures it once at the start of a step and hands every pass a
+		const reference, so a slider moved mid-step cannot change a value between two
+		passes, and the pair loops read locals the compiler can keep in registers rather
+		than globals any call might have written.
+
+		Derived values are only recomputed when their inputs change: the kernels and
+		their tables when h does, the rest when any setting does. Only grab_position is
+		refreshed every step.
+
+		FluidSim3D fills the physics, kernels and integrate constants for Dim = 3 and
+		leaves the 2D traversal options at their defaults.
+	*/
+	template <typename T, int Dim = 2>
+	struct SimParams
+	{
+		SimSettings settings;
+
+		// Settings in the compute type
+		T h = T(0);
+		T R2 = T(0);
+		T mass = T(0);
+		T rest_density = T(0);
+		T gas_constant = T(0);
+		T viscosity = T(0);
+		T gravity = T(0);
+		T dt = T(0);
+		T max_speed = T(0);
+		T max_speed2 = T(0);
+
+		KernelSet<T, Dim> kernels = KernelSet<T, Dim>(T(1));
+
+		IntegrateConstants<T> integrate;
+
+		// The float kernels take their constants in their own structs
+		KernelConstants kernel_constants = {};
+		ClusterPairList::Params cluster_params = {};
+		IntegrateParams integrate_params = {};
+
+		// Which passes run
+		Traversal traversal = Traversal::PerParticle;
+		SimdLevel simd_level = SimdLevel::Scalar;
+		unsigned force_terms = 0;
+		bool symmetric_forces = false;
+		bool fast_math = false;
+		// Pressure is computed in the density pass and each particle integrated in the force pass
+		bool fused = false;
+		// Integration writes the float GPU copy in external id order as well
+		bool stage_upload = false;
+		// Density to upload run as a graph of per-block tasks, see FluidSim2D::RunStepGraph
+		bool task_graph = false;
+		// Split of the per-particle density and force passes, Off for every other traversal
+		LoadBalance load_balance = LoadBalance::Off;
+		// Each pool thread's slice of the particle arrays is kept on its NUMA node
+		bool numa = false;
+
+		// Grid the step bins particles into
+		bool grid_dense = true;
+		float grid_cell_size = 0.0f;
+		int grid_width = 0;
+		float verlet_skin = 0.0f;
+		float verlet_radius = 0.0f;
+
+		T grab_radius2 = T(0);
+		glm::vec2 grab_position = glm::vec2(0.0f);
+	};
+}
@@ -0,0 +1,513 @@
+#include "SimdKernels.h"
+
+#include <cmath>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+	#define SIMD_X86
+	#include <immintrin.h>
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+	#else
+		#include <cpuid.h>
+	#endif
+#endif
+
+// GCC and Clang only emit vector instructions inside functions compiled for that target
+#if defined(_MSC_VER) && !defined(__clang__)
+	#define SIMD_TARGET_SSE42
+	#define SIMD_TARGET_AVX2
+#else
+	#define SIMD_TARGET_SSE42 __attribute__((target("sse4.2")))
+	#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace simulation {
+	const char* GetSimdLevelName(SimdLevel level)
+	{
+		switch (level) {
+		case SimdLevel::SSE42: return "SSE4.2";
+		case SimdLevel::AVX2: return "AVX2";
+		default: return "Scalar";
+		}
+	}
+
+#ifdef SIMD_X86
+	/*
+		Scalar integration of a single particle, used for the tail of a range that does
+		not fill a whole vector. Mirrors the reference loop in FluidSim2D::OnUpdate.
+	*/
+	template <unsigned Terms>
+	static inline void IntegrateParticle(const IntegrateParams& params, const IntegrateArrays& arrays, int i)
+	{
+		glm::vec2 F_total = arrays.F_pressure[i];
+		if constexpr ((Terms & TERM_VISCOSITY) != 0)
+			F_total += arrays.F_viscosity[i];
+		if constexpr ((Terms & TERM_EXTERNAL) != 0) {
+			F_total += arrays.F_other[i];
+			arrays.F_other[i] = glm::vec2(0.0f);
+		}
+		if constexpr ((Terms & TERM_GRAVITY) != 0)
+			F_total += params.mass * glm::vec2(0.0f, -params.gravity);
+
+		glm::vec2 acceleration = F_total / params.mass;
+		arrays.acceleration[i] = acceleration;
+
+		glm::vec2 velocity = arrays.velocity[i] + acceleration * params.dt;
+		float speed2 = glm::dot(velocity, velocity);
+		if (speed2 > params.max_speed * params.max_speed) {
+			velocity = glm::normalize(velocity) * params.max_speed;
+		}
+		glm::vec2 position = arrays.position[i] + velocity * params.dt;
+
+		if constexpr ((Terms & TERM_WALLS) != 0) {
+			for (int axis = 0; axis < 2; ++axis) {
+				if (position[axis] < params.domain_min) {
+					position[axis] = params.domain_min;
+					if constexpr ((Terms & TERM_WALL_DAMPING) != 0)
+						velocity[axis] *= params.damping;
+				}
+
+				if (position[axis] > params.domain_max) {
+					position[axis] = params.domain_max;
+					if constexpr ((Terms & TERM_WALL_DAMPING) != 0)
+						velocity[axis] *= params.damping;
+				}
+			}
+		}
+
+		arrays.position[i] = position;
+		arrays.velocity[i] = velocity;
+	}
+
+	static inline float TaitPressure(float density, float rest_density, float gas_constant)
+	{
+		float density_ratio = density / rest_density;
+		float r2 = density_ratio * density_ratio;
+		float r4 = r2 * r2;
+		float density_ratio7 = r4 * r2 * density_ratio;
+		return std::max(gas_constant * (density_ratio7 - 1.0f), 0.0f);
+	}
+
+	static void CpuId(int leaf, int subleaf, unsigned int regs[4])
+	{
+#if defined(_MSC_VER)
+		int r[4];
+		__cpuidex(r, leaf, subleaf);
+		for (int k = 0; k < 4; ++k) regs[k] = static_cast<unsigned int>(r[k]);
+#else
+		__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+	}
+
+	// Which register states the OS saves on a context switch
+	static unsigned long long ReadXCR0()
+	{
+#if defined(_MSC_VER)
+		return _xgetbv(0);
+#else
+		unsigned int lo, hi;
+		__asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+		return (static_cast<unsigned long long>(hi) << 32) | lo;
+#endif
+	}
+
+	SimdLevel DetectSimdLevel()
+	{
+		unsigned int regs[4];
+		CpuId(0, 0, regs);
+		const unsigned int max_leaf = regs[0];
+		if (max_leaf < 1)
+			return SimdLevel::Scalar;
+
+		CpuId(1, 0, regs);
+		const bool sse42 = (regs[2] & (1u << 20)) != 0;
+		const bool osxsave = (regs[2] & (1u << 27)) != 0;
+		const bool avx = (regs[2] & (1u << 28)) != 0;
+
+		// AVX registers are only usable if the OS saves the upper YMM halves
+		bool avx2 = false;
+		if (max_leaf >= 7 && avx && osxsave && (ReadXCR0() & 0x6) == 0x6) {
+			CpuId(7, 0, regs);
+			avx2 = (regs[1] & (1u << 5)) != 0;
+		}
+
+		if (avx2) return SimdLevel::AVX2;
+		if (sse42) return SimdLevel::SSE42;
+		return SimdLevel::Scalar;
+	}
+
+	/*
+		SSE4.2: 4 neighbours per iteration for the pair kernels, 2 particles per iteration
+		for Integrate.
+	*/
+	SIMD_TARGET_SSE42 static inline float HorizontalSumSSE(__m128 v)
+	{
+		__m128 shuffled = _mm_movehdup_ps(v);
+		__m128 sums = _mm_add_ps(v, shuffled);
+		shuffled = _mm_movehl_ps(shuffled, sums);
+		return _mm_cvtss_f32(_mm_add_ss(sums, shuffled));
+	}
+
+	SIMD_TARGET_SSE42 static float DensitySSE(const KernelConstants& k, const glm::vec2& position, const TileView& tile)
+	{
+		const __m128 px = _mm_set1_ps(position.x);
+		const __m128 py = _mm_set1_ps(position.y);
+		const __m128 R2 = _mm_set1_ps(k.R2);
+		__m128 sum = _mm_setzero_ps();
+
+		for (int t = 0; t < tile.size; t += 4) {
+			const __m128 dx = _mm_sub_ps(px, _mm_load_ps(tile.x + t));
+			const __m128 dy = _mm_sub_ps(py, _mm_load_ps(tile.y + t));
+			const __m128 dist2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+
+			// Neighbours outside the radius give a zero term
+			const __m128 term = _mm_sub_ps(R2, _mm_min_ps(dist2, R2));
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_mul_ps(term, term), term));
+		}
+		return k.mass * k.poly6 * HorizontalSumSSE(sum);
+	}
+
+	template <bool Viscosity>
+	SIMD_TARGET_SSE42 static ForceResult ForcesSSE(const KernelConstants& k, int i, const glm::vec2& position,
+		const glm::vec2& velocity, float pressure, const TileView& tile)
+	{
+		const __m128 px = _mm_set1_ps(position.x);
+		const __m128 py = _mm_set1_ps(position.y);
+		const __m128 vx = _mm_set1_ps(velocity.x);
+		const __m128 vy = _mm_set1_ps(velocity.y);
+		const __m128 p = _mm_set1_ps(pressure);
+		const __m128i self = _mm_set1_epi32(i);
+		const __m128 R2 = _mm_set1_ps(k.R2);
+		const __m128 min_dist2 = _mm_set1_ps(1e-6f);
+		const __m128 h = _mm_set1_ps(k.h);
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 neg_mass_spiky = _mm_set1_ps(-k.mass * k.spiky);
+		const __m128 mass_muller = _mm_set1_ps(k.mass * k.muller);
+
+		__m128 fpx = _mm_setzero_ps(), fpy = _mm_setzero_ps();
+		__m128 fvx = _mm_setzero_ps(), fvy = _mm_setzero_ps();
+
+		for (int t = 0; t < tile.size; t += 4) {
+			const __m128 dx = _mm_sub_ps(px, _mm_load_ps(tile.x + t));
+			const __m128 dy = _mm_sub_ps(py, _mm_load_ps(tile.y + t));
+			const __m128 dist2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+
+			const __m128 is_self = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_load_si128(reinterpret_cast<const __m128i*>(tile.index + t)), self));
+			const __m128 active = _mm_andnot_ps(is_self, _mm_and_ps(_mm_cmplt_ps(dist2, R2), _mm_cmpgt_ps(dist2, min_dist2)));
+
+			// Inactive lanes take r = h so nothing below divides by zero, then drop out via term
+			const __m128 r = _mm_sqrt_ps(_mm_blendv_ps(R2, dist2, active));
+			const __m128 term = _mm_and_ps(active, _mm_sub_ps(h, r));
+			const __m128 inv_density = _mm_div_ps(one, _mm_load_ps(tile.density + t));
+
+			// -m * 0.5 * (p_i + p_j) / rho_j * spiky * term^2 / r
+			const __m128 pressure_avg = _mm_mul_ps(_mm_mul_ps(half, _mm_add_ps(p, _mm_load_ps(tile.pressure + t))), inv_density);
+			const __m128 gradient = _mm_div_ps(_mm_mul_ps(neg_mass_spiky, _mm_mul_ps(term, term)), r);
+			const __m128 fp = _mm_mul_ps(pressure_avg, gradient);
+			fpx = _mm_add_ps(fpx, _mm_mul_ps(fp, dx));
+			fpy = _mm_add_ps(fpy, _mm_mul_ps(fp, dy));
+
+			// m * (v_j - v_i) / rho_j * muller * term
+			if constexpr (Viscosity) {
+				const __m128 visc = _mm_mul_ps(_mm_mul_ps(mass_muller, term), inv_density);
+				fvx = _mm_add_ps(fvx, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(tile.vx + t), vx), visc));
+				fvy = _mm_add_ps(fvy, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(tile.vy + t), vy), visc));
+			}
+		}
+
+		ForceResult result;
+		result.pressure = glm::vec2(HorizontalSumSSE(fpx), HorizontalSumSSE(fpy));
+		result.viscosity = Viscosity ? glm::vec2(HorizontalSumSSE(fvx), HorizontalSumSSE(fvy)) : glm::vec2(0.0f);
+		return result;
+	}
+
+	SIMD_TARGET_SSE42 static void PressureSSE(const float* density, float* pressure, int begin, int end,
+		float rest_density, float gas_constant)
+	{
+		const __m128 rest = _mm_set1_ps(rest_density);
+		const __m128 gas = _mm_set1_ps(gas_constant);
+		const __m128 one = _mm_set1_ps(1.0f);
+
+		int i = begin;
+		for (; i + 4 <= end; i += 4) {
+			const __m128 ratio = _mm_div_ps(_mm_loadu_ps(density + i), rest);
+			const __m128 r2 = _mm_mul_ps(ratio, ratio);
+			const __m128 r4 = _mm_mul_ps(r2, r2);
+			const __m128 ratio7 = _mm_mul_ps(_mm_mul_ps(r4, r2), ratio);
+			_mm_storeu_ps(pressure + i, _mm_max_ps(_mm_mul_ps(gas, _mm_sub_ps(ratio7, one)), _mm_setzero_ps()));
+		}
+		for (; i < end; ++i) {
+			pressure[i] = TaitPressure(density[i], rest_density, gas_constant);
+		}
+	}
+
+	template <unsigned Terms>
+	SIMD_TARGET_SSE42 static void IntegrateSSE(const IntegrateParams& params, const IntegrateArrays& arrays, int begin, int end)
+	{
+		// Every vec2 array is read as interleaved floats, x in even lanes and y in odd ones
+		const __m128 gravity = _mm_setr_ps(params.mass * 0.0f, params.mass * -params.gravity, params.mass * 0.0f, params.mass * -params.gravity);
+		const __m128 mass = _mm_set1_ps(params.mass);
+		const __m128 dt = _mm_set1_ps(params.dt);
+		const __m128 max_speed = _mm_set1_ps(params.max_speed);
+		const __m128 max_speed2 = _mm_set1_ps(params.max_speed * params.max_speed);
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 damping = _mm_set1_ps(params.damping);
+		const __m128 domain_min = _mm_set1_ps(params.domain_min);
+		const __m128 domain_max = _mm_set1_ps(params.domain_max);
+
+		int i = begin;
+		for (; i + 2 <= end; i += 2) {
+			__m128 F_total = _mm_loadu_ps(&arrays.F_pressure[i].x);
+			if constexpr ((Terms & TERM_VISCOSITY) != 0)
+				F_total = _mm_add_ps(F_total, _mm_loadu_ps(&arrays.F_viscosity[i].x));
+			if constexpr ((Terms & TERM_EXTERNAL) != 0) {
+				F_total = _mm_add_ps(F_total, _mm_loadu_ps(&arrays.F_other[i].x));
+				_mm_storeu_ps(&arrays.F_other[i].x, _mm_setzero_ps());
+			}
+			if constexpr ((Terms & TERM_GRAVITY) != 0)
+				F_total = _mm_add_ps(F_total, gravity);
+
+			const __m128 acceleration = _mm_div_ps(F_total, mass);
+			_mm_storeu_ps(&arrays.acceleration[i].x, acceleration);
+
+			__m128 velocity = _mm_add_ps(_mm_loadu_ps(&arrays.velocity[i].x), _mm_mul_ps(acceleration, dt));
+
+			// Both lanes of a particle get x^2 + y^2
+			const __m128 squared = _mm_mul_ps(velocity, velocity);
+			const __m128 speed2 = _mm_add_ps(squared, _mm_shuffle_ps(squared, squared, _MM_SHUFFLE(2, 3, 0, 1)));
+			const __m128 clamped = _mm_mul_ps(_mm_mul_ps(velocity, _mm_div_ps(one, _mm_sqrt_ps(speed2))), max_speed);
+			velocity = _mm_blendv_ps(velocity, clamped, _mm_cmpgt_ps(speed2, max_speed2));
+
+			__m128 position = _mm_add_ps(_mm_loadu_ps(&arrays.position[i].x), _mm_mul_ps(velocity, dt));
+
+			if constexpr ((Terms & TERM_WALLS) != 0) {
+				const __m128 below = _mm_cmplt_ps(position, domain_min);
+				position = _mm_blendv_ps(position, domain_min, below);
+				if constexpr ((Terms & TERM_WALL_DAMPING) != 0)
+					velocity = _mm_blendv_ps(velocity, _mm_mul_ps(velocity, damping), below);
+
+				const __m128 above = _mm_cmpgt_ps(position, domain_max);
+				position = _mm_blendv_ps(position, domain_max, above);
+				if constexpr ((Terms & TERM_WALL_DAMPING) != 0)
+					velocity = _mm_blendv_ps(velocity, _mm_mul_ps(velocity, damping), above);
+			}
+
+			_mm_storeu_ps(&arrays.position[i].x, position);
+			_mm_storeu_ps(&arrays.velocity[i].x, velocity);
+		}
+		for (; i < end; ++i) {
+			IntegrateParticle<Terms>(params, arrays, i);
+		}
+	}
+
+	/*
+		AVX2: 8 neighbours per iteration for the pair kernels, 4 particles per iteration
+		for Integrate. FMA is deliberately not used so Pressure and Integrate stay exact.
+	*/
+	SIMD_TARGET_AVX2 static inline float HorizontalSumAVX(__m256 v)
+	{
+		__m128 low = _mm256_castps256_ps128(v);
+		__m128 high = _mm256_extractf128_ps(v, 1);
+		low = _mm_add_ps(low, high);
+		__m128 shuffled = _mm_movehdup_ps(low);
+		__m128 sums = _mm_add_ps(low, shuffled);
+		shuffled = _mm_movehl_ps(shuffled, sums);
+		return _mm_cvtss_f32(_mm_add_ss(sums, shuffled));
+	}
+
+	SIMD_TARGET_AVX2 static float DensityAVX2(const KernelConstants& k, const glm::vec2& position, const TileView& tile)
+	{
+		const __m256 px = _mm256_set1_ps(position.x);
+		const __m256 py = _mm256_set1_ps(position.y);
+		const __m256 R2 = _mm256_set1_ps(k.R2);
+		__m256 sum = _mm256_setzero_ps();
+
+		for (int t = 0; t < tile.size; t += 8) {
+			const __m256 dx = _mm256_sub_ps(px, _mm256_load_ps(tile.x + t));
+			const __m256 dy = _mm256_sub_ps(py, _mm256_load_ps(tile.y + t));
+			const __m256 dist2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+
+			const __m256 term = _mm256_sub_ps(R2, _mm256_min_ps(dist2, R2));
+			sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_mul_ps(term, term), term));
+		}
+		return k.mass * k.poly6 * HorizontalSumAVX(sum);
+	}
+
+	template <bool Viscosity>
+	SIMD_TARGET_AVX2 static ForceResult ForcesAVX2(const KernelConstants& k, int i, const glm::vec2& position,
+		const glm::vec2& velocity, float pressure, const TileView& tile)
+	{
+		const __m256 px = _mm256_set1_ps(position.x);
+		const __m256 py = _mm256_set1_ps(position.y);
+		const __m256 vx = _mm256_set1_ps(velocity.x);
+		const __m256 vy = _mm256_set1_ps(velocity.y);
+		const __m256 p = _mm256_set1_ps(pressure);
+		const __m256i self = _mm256_set1_epi32(i);
+		const __m256 R2 = _mm256_set1_ps(k.R2);
+		const __m256 min_dist2 = _mm256_set1_ps(1e-6f);
+		const __m256 h = _mm256_set1_ps(k.h);
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 half = _mm256_set1_ps(0.5f);
+		const __m256 neg_mass_spiky = _mm256_set1_ps(-k.mass * k.spiky);
+		const __m256 mass_muller = _mm256_set1_ps(k.mass * k.muller);
+
+		__m256 fpx = _mm256_setzero_ps(), fpy = _mm256_setzero_ps();
+		__m256 fvx = _mm256_setzero_ps(), fvy = _mm256_setzero_ps();
+
+		for (int t = 0; t < tile.size; t += 8) {
+			const __m256 dx = _mm256_sub_ps(px, _mm256_load_ps(tile.x + t));
+			const __m256 dy = _mm256_sub_ps(py, _mm256_load_ps(tile.y + t));
+			const __m256 dist2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+
+			const __m256 is_self = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_load_si256(reinterpret_cast<const __m256i*>(tile.index + t)), self));
+			const __m256 in_range = _mm256_and_ps(_mm256_cmp_ps(dist2, R2, _CMP_LT_OQ), _mm256_cmp_ps(dist2, min_dist2, _CMP_GT_OQ));
+			const __m256 active = _mm256_andnot_ps(is_self, in_range);
+
+			const __m256 r = _mm256_sqrt_ps(_mm256_blendv_ps(R2, dist2, active));
+			const __m256 term = _mm256_and_ps(active, _mm256_sub_ps(h, r));
+			const __m256 inv_density = _mm256_div_ps(one, _mm256_load_ps(tile.density + t));
+
+			const __m256 pressure_avg = _mm256_mul_ps(_mm256_mul_ps(half, _mm256_add_ps(p, _mm256_load_ps(tile.pressure + t))), inv_density);
+			const __m256 gradient = _mm256_div_ps(_mm256_mul_ps(neg_mass_spiky, _mm256_mul_ps(term, term)), r);
+			const __m256 fp = _mm256_mul_ps(pressure_avg, gradient);
+			fpx = _mm256_add_ps(fpx, _mm256_mul_ps(fp, dx));
+			fpy = _mm256_add_ps(fpy, _mm256_mul_ps(fp, dy));
+
+			if constexpr (Viscosity) {
+				const __m256 visc = _mm256_mul_ps(_mm256_mul_ps(mass_muller, term), inv_density);
+				fvx = _mm256_add_ps(fvx, _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(tile.vx + t), vx), visc));
+				fvy = _mm256_add_ps(fvy, _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(tile.vy + t), vy), visc));
+			}
+		}
+
+		ForceResult result;
+		result.pressure = glm::vec2(HorizontalSumAVX(fpx), HorizontalSumAVX(fpy));
+		result.viscosity = Viscosity ? glm::vec2(HorizontalSumAVX(fvx), HorizontalSumAVX(fvy)) : glm::vec2(0.0f);
+		return result;
+	}
+
+	SIMD_TARGET_AVX2 static void PressureAVX2(const float* density, float* pressure, int begin, int end,
+		float rest_density, float gas_constant)
+	{
+		const __m256 rest = _mm256_set1_ps(rest_density);
+		const __m256 gas = _mm256_set1_ps(gas_constant);
+		const __m256 one = _mm256_set1_ps(1.0f);
+
+		int i = begin;
+		for (; i + 8 <= end; i += 8) {
+			const __m256 ratio = _mm256_div_ps(_mm256_loadu_ps(density + i), rest);
+			const __m256 r2 = _mm256_mul_ps(ratio, ratio);
+			const __m256 r4 = _mm256_mul_ps(r2, r2);
+			const __m256 ratio7 = _mm256_mul_ps(_mm256_mul_ps(r4, r2), ratio);
+			_mm256_storeu_ps(pressure + i, _mm256_max_ps(_mm256_mul_ps(gas, _mm256_sub_ps(ratio7, one)), _mm256_setzero_ps()));
+		}
+		for (; i < end; ++i) {
+			pressure[i] = TaitPressure(density[i], rest_density, gas_constant);
+		}
+	}
+
+	template <unsigned Terms>
+	SIMD_TARGET_AVX2 static void IntegrateAVX2(const IntegrateParams& params, const IntegrateArrays& arrays, int begin, int end)
+	{
+		const float gravity_x = params.mass * 0.0f;
+		const float gravity_y = params.mass * -params.gravity;
+		const __m256 gravity = _mm256_setr_ps(gravity_x, gravity_y, gravity_x, gravity_y, gravity_x, gravity_y, gravity_x, gravity_y);
+		const __m256 mass = _mm256_set1_ps(params.mass);
+		const __m256 dt = _mm256_set1_ps(params.dt);
+		const __m256 max_speed = _mm256_set1_ps(params.max_speed);
+		const __m256 max_speed2 = _mm256_set1_ps(params.max_speed * params.max_speed);
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 damping = _mm256_set1_ps(params.damping);
+		const __m256 domain_min = _mm256_set1_ps(params.domain_min);
+		const __m256 domain_max = _mm256_set1_ps(params.domain_max);
+
+		int i = begin;
+		for (; i + 4 <= end; i += 4) {
+			__m256 F_total = _mm256_loadu_ps(&arrays.F_pressure[i].x);
+			if constexpr ((Terms & TERM_VISCOSITY) != 0)
+				F_total = _mm256_add_ps(F_total, _mm256_loadu_ps(&arrays.F_viscosity[i].x));
+			if constexpr ((Terms & TERM_EXTERNAL) != 0) {
+				F_total = _mm256_add_ps(F_total, _mm256_loadu_ps(&arrays.F_other[i].x));
+				_mm256_storeu_ps(&arrays.F_other[i].x, _mm256_setzero_ps());
+			}
+			if constexpr ((Terms & TERM_GRAVITY) != 0)
+				F_total = _mm256_add_ps(F_total, gravity);
+
+			const __m256 acceleration = _mm256_div_ps(F_total, mass);
+			_mm256_storeu_ps(&arrays.acceleration[i].x, acceleration);
+
+			__m256 velocity = _mm256_add_ps(_mm256_loadu_ps(&arrays.velocity[i].x), _mm256_mul_ps(acceleration, dt));
+
+			const __m256 squared = _mm256_mul_ps(velocity, velocity);
+			const __m256 speed2 = _mm256_add_ps(squared, _mm256_permute_ps(squared, _MM_SHUFFLE(2, 3, 0, 1)));
+			const __m256 clamped = _mm256_mul_ps(_mm256_mul_ps(velocity, _mm256_div_ps(one, _mm256_sqrt_ps(speed2))), max_speed);
+			velocity = _mm256_blendv_ps(velocity, clamped, _mm256_cmp_ps(speed2, max_speed2, _CMP_GT_OQ));
+
+			__m256 position = _mm256_add_ps(_mm256_loadu_ps(&arrays.position[i].x), _mm256_mul_ps(velocity, dt));
+
+			if constexpr ((Terms & TERM_WALLS) != 0) {
+				const __m256 below = _mm256_cmp_ps(position, domain_min, _CMP_LT_OQ);
+				position = _mm256_blendv_ps(position, domain_min, below);
+				if constexpr ((Terms & TERM_WALL_DAMPING) != 0)
+					velocity = _mm256_blendv_ps(velocity, _mm256_mul_ps(velocity, damping), below);
+
+				const __m256 above = _mm256_cmp_ps(position, domain_max, _CMP_GT_OQ);
+				position = _mm256_blendv_ps(position, domain_max, above);
+				if constexpr ((Terms & TERM_WALL_DAMPING) != 0)
+					velocity = _mm256_blendv_ps(velocity, _mm256_mul_ps(velocity, damping), above);
+			}
+
+			_mm256_storeu_ps(&arrays.position[i].x, position);
+			_mm256_storeu_ps(&arrays.velocity[i].x, velocity);
+		}
+		for (; i < end; ++i) {
+			IntegrateParticle<Terms>(params, arrays, i);
+		}
+	}
+
+	struct IntegrateSSEFactory {
+		template <unsigned Terms>
+		static constexpr SimdKernels::IntegrateKernel Get() { return &IntegrateSSE<Terms>; }
+	};
+
+	struct IntegrateAVX2Factory {
+		template <unsigned Terms>
+		static constexpr SimdKernels::IntegrateKernel Get() { return &IntegrateAVX2<Terms>; }
+	};
+
+	static const SimdKernels s_KernelsSSE42 = {
+		DensitySSE,
+		{ ForcesSSE<false>, ForcesSSE<true> },
+		PressureSSE,
+		MakeForceTermTable<IntegrateSSEFactory>()
+	};
+
+	static const SimdKernels s_KernelsAVX2 = {
+		DensityAVX2,
+		{ ForcesAVX2<false>, ForcesAVX2<true> },
+		PressureAVX2,
+		MakeForceTermTable<IntegrateAVX2Factory>()
+	};
+
+	const SimdKernels* GetSimdKernels(SimdLevel level)
+	{
+		switch (level) {
+		case SimdLevel::SSE42: return &s_KernelsSSE42;
+		case SimdLevel::AVX2: return &s_KernelsAVX2;
+		default: return nullptr;
+		}
+	}
+#else
+	SimdLevel DetectSimdLevel()
+	{
+		return SimdLevel::Scalar;
+	}
+
+	const SimdKernels* GetSimdKernels(SimdLevel)
+	{
+		return nullptr;
+	}
+#endif
+}
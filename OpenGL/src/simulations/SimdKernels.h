@@ -0,0 +1,95 @@
+#pragma once
+
+#include "ForceTerms.h"
+
+#include "glm/glm.hpp"
+
+#include <array>
+
+namespace simulation {
+	/*
+		Hand vectorised versions of the hot per-particle loops, selected at runtime from
+		what CPUID reports. The scalar code in FluidSim2D stays the reference; these only
+		differ from it in summation order, except Pressure and Integrate which perform the
+		same operations per lane and match it exactly.
+
+		Only x86 builds get vector kernels. Everywhere else (including wasm) the detected
+		level is always Scalar.
+	*/
+	enum class SimdLevel { Scalar, SSE42, AVX2 };
+
+	SimdLevel DetectSimdLevel();
+	const char* GetSimdLevelName(SimdLevel level);
+
+	// Neighbour tiles passed to the pair kernels must be padded to a multiple of this
+	static constexpr int SIMD_TILE_PADDING = 8;
+
+	struct KernelConstants {
+		float h;
+		float R2;
+		float mass;
+		float poly6;
+		float spiky;
+		float muller;
+	};
+
+	// Structure of Arrays view of a padded neighbour tile, padding slots have index -1
+	struct TileView {
+		const int* index;
+		const float* x;
+		const float* y;
+		const float* vx;
+		const float* vy;
+		const float* density;
+		const float* pressure;
+		int size;
+	};
+
+	struct ForceResult {
+		glm::vec2 pressure;
+		glm::vec2 viscosity;
+	};
+
+	struct IntegrateParams {
+		float mass;
+		float gravity;
+		float dt;
+		float max_speed;
+		float damping;
+		float domain_min;
+		float domain_max;
+	};
+
+	struct IntegrateArrays {
+		glm::vec2* position;
+		glm::vec2* velocity;
+		glm::vec2* acceleration;
+		const glm::vec2* F_pressure;
+		const glm::vec2* F_viscosity;
+		glm::vec2* F_other;		// Cleared once added, see TERM_EXTERNAL
+	};
+
+	struct SimdKernels {
+		// Density of a particle at position from every entry of the tile
+		using DensityKernel = float (*)(const KernelConstants& k, const glm::vec2& position, const TileView& tile);
+
+		// Pressure and viscosity forces on particle i (velocity, pressure) from the tile
+		using ForceKernel = ForceResult (*)(const KernelConstants& k, int i, const glm::vec2& position,
+			const glm::vec2& velocity, float pressure, const TileView& tile);
+
+		// Tait pressure of particles [begin, end)
+		using PressureKernel = void (*)(const float* density, float* pressure, int begin, int end,
+			float rest_density, float gas_constant);
+
+		// Force summation, velocity clamp, advection and wall collisions of particles [begin, end)
+		using IntegrateKernel = void (*)(const IntegrateParams& params, const IntegrateArrays& arrays, int begin, int end);
+
+		DensityKernel Density;
+		ForceKernel Forces[2];	// Indexed by whether TERM_VISCOSITY is enabled
+		PressureKernel Pressure;
+		std::array<IntegrateKernel, FORCE_TERM_COMBINATIONS> Integrate;	// Indexed by the ForceTerm mask
+	};
+
+	// Returns nullptr for SimdLevel::Scalar
+	const SimdKernels* GetSimdKernels(SimdLevel level);
+}
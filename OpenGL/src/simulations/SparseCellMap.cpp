@@ -0,0 +1,51 @@
+#include "SparseCellMap.h"
+
+#include <algorithm>
+
+namespace simulation {
+	// Probe sequences stay short below half occupancy
+	static constexpr float MAX_LOAD_FACTOR = 0.5f;
+
+	SparseCellMap::SparseCellMap()
+		: m_Mask(0), m_Size(0)
+	{
+	}
+
+	void SparseCellMap::Reset(int maxCells)
+	{
+		unsigned int capacity = 16;
+		while (capacity * MAX_LOAD_FACTOR < maxCells)
+			capacity <<= 1;
+
+		if (m_Table.size() != capacity)
+			m_Table.resize(capacity);
+		std::fill(m_Table.begin(), m_Table.end(), Entry{ glm::ivec2(0), -1 });
+
+		m_Mask = capacity - 1;
+		m_Size = 0;
+	}
+
+	int SparseCellMap::Insert(const glm::ivec2& cell)
+	{
+		unsigned int idx = Hash(cell);
+		while (m_Table[idx].slot != -1) {
+			if (m_Table[idx].cell == cell)
+				return m_Table[idx].slot;
+			idx = (idx + 1) & m_Mask;
+		}
+
+		m_Table[idx] = Entry{ cell, m_Size };
+		return m_Size++;
+	}
+
+	int SparseCellMap::Find(const glm::ivec2& cell) const
+	{
+		unsigned int idx = Hash(cell);
+		while (m_Table[idx].slot != -1) {
+			if (m_Table[idx].cell == cell)
+				return m_Table[idx].slot;
+			idx = (idx + 1) & m_Mask;
+		}
+		return -1;
+	}
+}
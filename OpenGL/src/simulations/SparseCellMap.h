@@ -0,0 +1,45 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include <vector>
+
+namespace simulation {
+	/*
+		Open addressing (linear probing) table from exact integer cell coordinates to a
+		compact slot id in [0, Size()). Only occupied cells get an entry, so memory follows
+		the number of live cells rather than the area of the domain, and distinct cells
+		never share a slot.
+	*/
+	class SparseCellMap
+	{
+	public:
+		SparseCellMap();
+
+		// Clears the map and sizes it so `maxCells` entries stay under the load factor
+		void Reset(int maxCells);
+
+		int Insert(const glm::ivec2& cell);
+		int Find(const glm::ivec2& cell) const;
+
+		inline int Size() const { return m_Size; }
+		inline int Capacity() const { return static_cast<int>(m_Table.size()); }
+
+	private:
+		struct Entry {
+			glm::ivec2 cell;
+			int slot;
+		};
+
+		inline unsigned int Hash(const glm::ivec2& cell) const
+		{
+			unsigned int hash_x = static_cast<unsigned int>(cell.x) * 98561123u;
+			unsigned int hash_y = static_cast<unsigned int>(cell.y) * 863421509u;
+			return (hash_x ^ hash_y) & m_Mask;
+		}
+
+		std::vector<Entry> m_Table;
+		unsigned int m_Mask;
+		int m_Size;
+	};
+}
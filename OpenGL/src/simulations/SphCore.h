@@ -0,0 +1,103 @@
+#pragma once
+
+#include "ForceTerms.h"
+
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace simulation {
+	/*
+		The per-particle steps of the solver that do not depend on how neighbours are
+		found, written once for glm::vec<Dim, T> and shared by FluidSim2D and FluidSim3D.
+		With Dim = 2 they evaluate exactly what the 2D passes always have.
+	*/
+
+	/*
+		What integrating one particle needs, in the compute type. Small enough for a pass
+		to copy into a local, so the constants stay in registers next to its stores.
+	*/
+	template <typename T>
+	struct IntegrateConstants
+	{
+		T mass = T(0);
+		T gravity = T(0);
+		T dt = T(0);
+		T max_speed = T(0);
+		T max_speed2 = T(0);
+		T damping = T(0);
+		T domain_min = T(0);	// Wall planes, the same on every axis
+		T domain_max = T(0);
+		unsigned terms = 0;		// ForceTerm mask
+	};
+
+	/*
+		xorshift32 for the initial jitter. std::rand differs between C libraries, so the
+		native and wasm builds would not start from the same state.
+	*/
+	inline uint32_t NextJitter(uint32_t& state)
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+
+	// Tait's equation, clamped so particles below rest density do not attract
+	template <typename T>
+	inline T TaitPressure(T density, T rest_density, T gas_constant)
+	{
+		T density_ratio = density / rest_density;
+		T r2 = density_ratio * density_ratio;
+		T r4 = r2 * r2;
+		T density_ratio7 = r4 * r2 * density_ratio;
+		return std::max(gas_constant * (density_ratio7 - T(1)), T(0));
+	}
+
+	// Weight of one particle, pointing down the y axis in 2D and 3D alike
+	template <int Dim, typename T>
+	inline glm::vec<Dim, T> GravityForce(const IntegrateConstants<T>& integrate)
+	{
+		glm::vec<Dim, T> down(T(0));
+		down[1] = -integrate.gravity;
+		return integrate.mass * down;
+	}
+
+	/*
+		Advances a particle by one step from its acceleration: velocity, capped at
+		max_speed, then position, then the walls. The walls are applied when they are in
+		both Terms and integrate.terms, so a caller with a compile-time mask pays nothing
+		for disabled ones.
+	*/
+	template <unsigned Terms, int Dim, typename T>
+	inline void AdvanceParticle(const IntegrateConstants<T>& integrate, const glm::vec<Dim, T>& acceleration,
+		glm::vec<Dim, T>& position, glm::vec<Dim, T>& velocity)
+	{
+		velocity = velocity + acceleration * integrate.dt;
+		T speed2 = glm::dot(velocity, velocity);
+		if (speed2 > integrate.max_speed2) {
+			velocity = glm::normalize(velocity) * integrate.max_speed;
+		}
+		position = position + velocity * integrate.dt;
+
+		// Boundary conditions
+		if constexpr ((Terms & TERM_WALLS) != 0) {
+			const unsigned terms = integrate.terms & Terms;
+			if (terms & TERM_WALLS) {
+				const bool damping = (terms & TERM_WALL_DAMPING) != 0;
+				for (int axis = 0; axis < Dim; ++axis) {
+					if (position[axis] < integrate.domain_min) {
+						position[axis] = integrate.domain_min;
+						if (damping) velocity[axis] *= integrate.damping;
+					}
+
+					if (position[axis] > integrate.domain_max) {
+						position[axis] = integrate.domain_max;
+						if (damping) velocity[axis] *= integrate.damping;
+					}
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,286 @@
+#pragma once
+
+#include <cmath>
+#include <array>
+#include <memory>
+#include <algorithm>
+#include <type_traits>
+
+namespace simulation {
+	/*
+		SPH smoothing kernel policies. Each one is built from the smoothing radius h,
+		folding every power of h into its coefficients, so the pair loops only do
+		multiplications. SimParams keeps one of each, rebuilt only when h changes. All
+		kernels have compact support r < h and are evaluated in the solver's compute
+		type T.
+
+		Dim is the number of spatial dimensions, 2 or 3. Only the normalisation depends
+		on it, so W integrates to one over a disc or a ball of radius h.
+
+		Density(r2)   W for a neighbour at squared distance r2
+		Gradient(r)   dW/dr, multiplied by the unit direction to get grad W
+		Laplacian(r)  the Laplacian used by the viscosity force
+	*/
+	enum class KernelShape { Poly6Spiky, CubicSpline, WendlandC2, WendlandC4 };
+
+	static constexpr int KERNEL_SHAPE_COUNT = 4;
+
+	template <typename T>
+	static constexpr T KERNEL_PI = T(3.14159265358979323846);
+
+	/*
+		Muller et al. 2003: Poly6 for density, Spiky for pressure and the viscosity kernel's
+		Laplacian. In 2D it is evaluated exactly as the original hard-coded loops were,
+		which kept the 3D gradient and Laplacian constants; 3D uses the paper's Poly6
+		normalisation, 315 / (64 pi h^9).
+	*/
+	template <typename T, int Dim = 2>
+	struct Poly6SpikyKernel
+	{
+		using Scalar = T;
+		static constexpr int DIM = Dim;
+
+		static constexpr T DENSITY_NORM = Dim == 2 ? T(4) : T(315) / T(64);
+		static constexpr T GRADIENT_NORM = T(-45);
+		static constexpr T LAPLACIAN_NORM = T(45);
+
+		explicit Poly6SpikyKernel(T h)
+		{
+			const T h2 = h * h;
+			const T h6 = h2 * h2 * h2;
+			const T h8 = (h2 * h2) * (h2 * h2);
+			m_H = h;
+			m_H2 = h2;
+			m_Density = DENSITY_NORM / (KERNEL_PI<T> * (Dim == 2 ? h8 : h8 * h));
+			m_Gradient = GRADIENT_NORM / (KERNEL_PI<T> * h6);
+			m_Laplacian = LAPLACIAN_NORM / (KERNEL_PI<T> * h6);
+		}
+
+		inline T Density(T r2) const
+		{
+			const T term = m_H2 - r2;
+			return m_Density * term * term * term;
+		}
+
+		inline T Gradient(T r) const
+		{
+			const T term = m_H - r;
+			return m_Gradient * term * term;
+		}
+
+		inline T Laplacian(T r) const
+		{
+			return m_Laplacian * (m_H - r);
+		}
+
+	private:
+		T m_H, m_H2;
+		T m_Density, m_Gradient, m_Laplacian;
+	};
+
+	/*
+		Kernels written in terms of q = r / h, W = sigma / h^Dim * f(q). The shape f is
+		the same in 2D and 3D, only sigma changes. They use the Brookshaw approximation
+		for the Laplacian, -2 / r * dW/dr, which stays finite as r -> 0 for all three.
+	*/
+	template <template <typename, int> class Shape, typename T, int Dim = 2>
+	struct RadialKernel
+	{
+		using Scalar = T;
+		using Form = Shape<T, Dim>;
+		static constexpr int DIM = Dim;
+
+		explicit RadialKernel(T h)
+		{
+			m_InvH = T(1) / h;
+			m_Density = Form::SIGMA;
+			for (int d = 0; d < Dim; ++d)
+				m_Density *= m_InvH;
+			m_Gradient = m_Density * m_InvH;
+		}
+
+		inline T Density(T r2) const
+		{
+			return m_Density * Form::F(std::sqrt(r2) * m_InvH);
+		}
+
+		inline T Gradient(T r) const
+		{
+			return m_Gradient * Form::DF(r * m_InvH);
+		}
+
+		inline T Laplacian(T r) const
+		{
+			return T(-2) * Gradient(r) / r;
+		}
+
+	private:
+		T m_InvH;
+		T m_Density, m_Gradient;
+	};
+
+	// Monaghan's M4 cubic B-spline
+	template <typename T, int Dim>
+	struct CubicSplineShape
+	{
+		static constexpr T SIGMA = Dim == 2 ? T(40) / (T(7) * KERNEL_PI<T>) : T(8) / KERNEL_PI<T>;
+
+		static inline T F(T q)
+		{
+			if (q <= T(0.5))
+				return T(6) * (q * q * q - q * q) + T(1);
+			const T t = T(1) - q;
+			return T(2) * t * t * t;
+		}
+
+		static inline T DF(T q)
+		{
+			if (q <= T(0.5))
+				return T(6) * (T(3) * q * q - T(2) * q);
+			const T t = T(1) - q;
+			return T(-6) * t * t;
+		}
+	};
+
+	// Wendland C2, (1 - q)^4 (1 + 4q)
+	template <typename T, int Dim>
+	struct WendlandC2Shape
+	{
+		static constexpr T SIGMA = Dim == 2 ? T(7) / KERNEL_PI<T> : T(21) / (T(2) * KERNEL_PI<T>);
+
+		static inline T F(T q)
+		{
+			const T t = T(1) - q;
+			const T t2 = t * t;
+			return t2 * t2 * (T(1) + T(4) * q);
+		}
+
+		static inline T DF(T q)
+		{
+			const T t = T(1) - q;
+			return T(-20) * q * t * t * t;
+		}
+	};
+
+	// Wendland C4, (1 - q)^6 (1 + 6q + 35/3 q^2)
+	template <typename T, int Dim>
+	struct WendlandC4Shape
+	{
+		static constexpr T SIGMA = Dim == 2 ? T(9) / KERNEL_PI<T> : T(495) / (T(32) * KERNEL_PI<T>);
+
+		static inline T F(T q)
+		{
+			const T t = T(1) - q;
+			const T t2 = t * t;
+			return t2 * t2 * t2 * (T(1) + T(6) * q + (T(35) / T(3)) * q * q);
+		}
+
+		static inline T DF(T q)
+		{
+			const T t = T(1) - q;
+			const T t2 = t * t;
+			return (T(-56) / T(3)) * q * t2 * t2 * t * (T(1) + T(5) * q);
+		}
+	};
+
+	template <typename T, int Dim = 2>
+	using CubicSplineKernel = RadialKernel<CubicSplineShape, T, Dim>;
+	template <typename T, int Dim = 2>
+	using WendlandC2Kernel = RadialKernel<WendlandC2Shape, T, Dim>;
+	template <typename T, int Dim = 2>
+	using WendlandC4Kernel = RadialKernel<WendlandC4Shape, T, Dim>;
+
+	/*
+		Any kernel sampled at TABLE_SIZE + 1 evenly spaced r2 in [0, h^2] and linearly
+		interpolated, so every evaluation is a multiply, a truncation and a lerp whatever
+		the shape. Gradient(r) and Laplacian(r) look up r * r; the passes using it get r
+		from FastInverseSqrt, so they have r2 at hand anyway.
+
+		The tables are built by the constructor and shared by its copies, so a kernel
+		should be constructed once per h (SimParams does so) and copied from there. Three
+		tables of 1025 floats are 12 KB, small enough to stay in L1 next to the particle
+		data.
+
+		Interpolating in r2 is exact to within rounding for Poly6, which is a polynomial
+		in r2, but the radial kernels and Spiky behave like sqrt(r2) near r = 0, where a
+		linear fit is worst. Measured against the exact kernels over 200 steps of the
+		default scene (RMS / max error relative to the RMS of the exact force):
+			Poly6 / Spiky   pressure force 7e-4 / 9e-3
+			Cubic Spline    pressure force 1e-2 / 1e-1
+			Wendland C2     pressure force 8e-3 / 8e-2
+			Wendland C4     pressure force 1.4e-2 / 2.3e-1
+		Density and the viscous force stay below 1e-3 for every shape. The error falls
+		slightly faster than 1 / TABLE_SIZE.
+	*/
+	template <typename Kernel>
+	struct TabulatedKernel
+	{
+		using Scalar = typename Kernel::Scalar;
+		using T = Scalar;
+
+		static constexpr int TABLE_SIZE = 1024;
+
+		explicit TabulatedKernel(T h)
+			: m_Tables(std::make_shared<const Tables>(h)), m_Scale(m_Tables->scale)
+		{
+		}
+
+		inline T Density(T r2) const { return Lookup(m_Tables->density, r2); }
+		inline T Gradient(T r) const { return Lookup(m_Tables->gradient, r * r); }
+		inline T Laplacian(T r) const { return Lookup(m_Tables->laplacian, r * r); }
+
+	private:
+		// One padding entry, so r2 rounded up to h^2 still has a right neighbour
+		using Table = std::array<T, TABLE_SIZE + 2>;
+
+		struct Tables {
+			T h;
+			T scale;
+			Table density, gradient, laplacian;
+
+			explicit Tables(T smoothing_radius)
+				: h(smoothing_radius), scale(T(TABLE_SIZE) / (smoothing_radius * smoothing_radius))
+			{
+				const Kernel kernel(h);
+				for (int k = 0; k <= TABLE_SIZE; ++k) {
+					const T r2 = T(k) / scale;
+					// The Brookshaw Laplacian is 0 / 0 at r = 0, so sample just beside it
+					const T r = std::max(std::sqrt(r2), h * T(1e-4));
+					density[k] = kernel.Density(r2);
+					gradient[k] = kernel.Gradient(r);
+					laplacian[k] = kernel.Laplacian(r);
+				}
+				density[TABLE_SIZE + 1] = density[TABLE_SIZE];
+				gradient[TABLE_SIZE + 1] = gradient[TABLE_SIZE];
+				laplacian[TABLE_SIZE + 1] = laplacian[TABLE_SIZE];
+			}
+		};
+
+		inline T Lookup(const Table& table, T r2) const
+		{
+			const T x = r2 * m_Scale;
+			const int k = std::min(static_cast<int>(x), TABLE_SIZE);
+			const T t = x - T(k);
+			return table[k] + t * (table[k + 1] - table[k]);
+		}
+
+		std::shared_ptr<const Tables> m_Tables;
+		T m_Scale;
+	};
+
+	// Approximate kernels tell the passes to use FastInverseSqrt and 1 / density as well
+	template <typename Kernel>
+	struct IsApproximateKernel : std::false_type {};
+	template <typename Kernel>
+	struct IsApproximateKernel<TabulatedKernel<Kernel>> : std::true_type {};
+
+	inline const char* GetKernelShapeName(KernelShape shape)
+	{
+		switch (shape) {
+		case KernelShape::CubicSpline: return "Cubic Spline";
+		case KernelShape::WendlandC2: return "Wendland C2";
+		case KernelShape::WendlandC4: return "Wendland C4";
+		default: return "Poly6 / Spiky";
+		}
+	}
+}
@@ -0,0 +1,101 @@
+#include "TaskGraph.h"
+#include "ParallelBackend.h"
+
+namespace Utils {
+	void TaskGraph::Clear()
+	{
+		for (int t = 0; t < m_TaskCount; ++t) {
+			m_Tasks[t].successors.clear();
+			m_Tasks[t].dependencies = 0;
+			m_Tasks[t].main_thread = false;
+		}
+		m_TaskCount = 0;
+		m_EdgeCount = 0;
+	}
+
+	int TaskGraph::Add(bool mainThread)
+	{
+		if (m_TaskCount == static_cast<int>(m_Tasks.size()))
+			m_Tasks.emplace_back();
+
+		m_Tasks[m_TaskCount].main_thread = mainThread;
+		return m_TaskCount++;
+	}
+
+	void TaskGraph::Depend(int task, int dependency)
+	{
+		m_Tasks[dependency].successors.push_back(task);
+		m_Tasks[task].dependencies++;
+		m_EdgeCount++;
+	}
+
+	void TaskGraph::Run(TaskFunc func, void* context)
+	{
+		if (m_TaskCount == 0)
+			return;
+
+		if (m_PendingCapacity < m_TaskCount) {
+			m_Pending = std::make_unique<std::atomic<int>[]>(m_TaskCount);
+			m_PendingCapacity = m_TaskCount;
+		}
+
+		m_Ready.clear();
+		m_MainReady.clear();
+		for (int t = 0; t < m_TaskCount; ++t) {
+			m_Pending[t].store(m_Tasks[t].dependencies, std::memory_order_relaxed);
+			if (m_Tasks[t].dependencies == 0)
+				PushReady(t);
+		}
+		m_Finished.store(0, std::memory_order_relaxed);
+		m_MainThread = std::this_thread::get_id();
+
+		// One item per thread, each working through ready tasks until the graph is done
+		auto work = [&](int, int) { Work(func, context); };
+		RunParallel(0, GetParallelThreadCount(), 1, work);
+	}
+
+	void TaskGraph::Work(TaskFunc func, void* context)
+	{
+		const bool main_thread = std::this_thread::get_id() == m_MainThread;
+		while (m_Finished.load(std::memory_order_acquire) < m_TaskCount) {
+			int task;
+			if (!PopReady(main_thread, task)) {
+				std::this_thread::yield();
+				continue;
+			}
+
+			func(context, task);
+			for (int successor : m_Tasks[task].successors) {
+				if (m_Pending[successor].fetch_sub(1, std::memory_order_acq_rel) == 1)
+					PushReady(successor);
+			}
+			m_Finished.fetch_add(1, std::memory_order_acq_rel);
+		}
+	}
+
+	bool TaskGraph::PopReady(bool mainThread, int& task)
+	{
+		std::lock_guard<std::mutex> lock(m_ReadyMutex);
+		if (mainThread && !m_MainReady.empty()) {
+			task = m_MainReady.front();
+			m_MainReady.pop_front();
+			return true;
+		}
+		if (m_Ready.empty())
+			return false;
+
+		// Oldest first, so a stage drains roughly in block order
+		task = m_Ready.front();
+		m_Ready.pop_front();
+		return true;
+	}
+
+	void TaskGraph::PushReady(int task)
+	{
+		std::lock_guard<std::mutex> lock(m_ReadyMutex);
+		if (m_Tasks[task].main_thread)
+			m_MainReady.push_back(task);
+		else
+			m_Ready.push_back(task);
+	}
+}
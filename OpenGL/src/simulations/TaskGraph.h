@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Utils {
+	/*
+		Dependency graph of tasks executed on the parallel backend. A task becomes ready once
+		every task it depends on has finished, so work downstream of a slow task does not
+		wait for the whole stage it belongs to. Tasks marked as main thread tasks (GL
+		calls) are only taken by the thread that called Run(), which works through the
+		other ready tasks while it has none of its own.
+
+		Tasks are plain indices; Run() calls one function with the index of each task.
+		The graph keeps its storage between Clear() calls so a step can rebuild it
+		without allocating.
+	*/
+	class TaskGraph
+	{
+	public:
+		using TaskFunc = void (*)(void* context, int task);
+
+		void Clear();
+
+		// Adds a task and returns its index
+		int Add(bool mainThread = false);
+
+		// Task runs only after dependency has finished. Dependencies must be added first.
+		void Depend(int task, int dependency);
+
+		inline int GetTaskCount() const { return m_TaskCount; }
+		inline int GetEdgeCount() const { return m_EdgeCount; }
+
+		void Run(TaskFunc func, void* context);
+
+		template <typename Func>
+		void Run(Func& func)
+		{
+			Run([](void* context, int task) { (*static_cast<Func*>(context))(task); }, &func);
+		}
+
+	private:
+		struct Task
+		{
+			std::vector<int> successors;
+			int dependencies = 0;
+			bool main_thread = false;
+		};
+
+		void Work(TaskFunc func, void* context);
+		bool PopReady(bool mainThread, int& task);
+		void PushReady(int task);
+
+		std::vector<Task> m_Tasks;
+		int m_TaskCount = 0;
+		int m_EdgeCount = 0;
+
+		// Dependencies still outstanding for each task during Run()
+		std::unique_ptr<std::atomic<int>[]> m_Pending;
+		int m_PendingCapacity = 0;
+
+		std::mutex m_ReadyMutex;
+		std::deque<int> m_Ready;
+		std::deque<int> m_MainReady;
+		std::atomic<int> m_Finished{ 0 };
+		std::thread::id m_MainThread;
+	};
+}
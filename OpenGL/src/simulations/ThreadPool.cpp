@@ -0,0 +1,271 @@
+#include "ThreadPool.h"
+#include "NumaTopology.h"
+
+#include <algorithm>
+
+#if defined(_WIN32)
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <Windows.h>
+#elif defined(__linux__) && !defined(__EMSCRIPTEN__)
+	#include <pthread.h>
+	#include <sched.h>
+#endif
+
+namespace Utils {
+	// Polls for the next loop before sleeping, so back to back passes do not pay a wake up each
+	static constexpr int SPIN_COUNT = 2000;
+
+	// Set on pool threads, and on the caller while it runs a loop, so nested loops run inline
+	static thread_local bool t_InPool = false;
+
+	static void PinThread(std::thread& thread, int core)
+	{
+#if defined(_WIN32)
+		SetThreadAffinityMask(thread.native_handle(), static_cast<DWORD_PTR>(1) << core);
+#elif defined(__linux__) && !defined(__EMSCRIPTEN__)
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(core, &set);
+		pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+		(void)thread;
+		(void)core;
+#endif
+	}
+
+	// The caller's affinity from before Resize() pinned it, put back when pinning is turned off
+#if defined(_WIN32)
+	static DWORD_PTR s_CallerAffinity = 0;
+#elif defined(__linux__) && !defined(__EMSCRIPTEN__)
+	static cpu_set_t s_CallerAffinity;
+#endif
+	static bool s_CallerPinned = false;
+
+	static void PinCaller(bool pin, int core)
+	{
+		if (pin == s_CallerPinned)
+			return;
+
+#if defined(_WIN32)
+		if (pin)
+			s_CallerAffinity = SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << core);
+		else
+			SetThreadAffinityMask(GetCurrentThread(), s_CallerAffinity);
+#elif defined(__linux__) && !defined(__EMSCRIPTEN__)
+		if (pin) {
+			pthread_getaffinity_np(pthread_self(), sizeof(s_CallerAffinity), &s_CallerAffinity);
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET(core, &set);
+			pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+		} else {
+			pthread_setaffinity_np(pthread_self(), sizeof(s_CallerAffinity), &s_CallerAffinity);
+		}
+#else
+		(void)core;
+#endif
+		s_CallerPinned = pin;
+	}
+
+	ThreadPool& ThreadPool::Get()
+	{
+		static ThreadPool pool;
+		return pool;
+	}
+
+	ThreadPool::ThreadPool()
+	{
+		Resize(DefaultWorkerCount(), false);
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		Stop();
+	}
+
+	int ThreadPool::DefaultWorkerCount()
+	{
+#ifdef __EMSCRIPTEN__
+		return 0;
+#else
+		return std::max(1, static_cast<int>(std::thread::hardware_concurrency())) - 1;
+#endif
+	}
+
+	void ThreadPool::Resize(int workerCount, bool pin)
+	{
+#ifdef __EMSCRIPTEN__
+		workerCount = 0;
+#endif
+		std::lock_guard<std::mutex> run_lock(m_RunMutex);
+		Stop();
+
+		workerCount = std::max(0, workerCount);
+		m_Queues.clear();
+		for (int i = 0; i <= workerCount; ++i)
+			m_Queues.push_back(std::make_unique<Queue>());
+
+		m_Stopping = false;
+		m_Pinned = pin;
+		const NumaTopology& topology = NumaTopology::Get();
+		const std::vector<int>& cores = topology.GetCpuOrder();
+		m_ThreadNode.assign(workerCount + 1, -1);
+
+		// The caller runs the first slice of every loop, so it takes the first core
+		PinCaller(pin, cores[0]);
+		if (pin)
+			m_ThreadNode[0] = topology.GetCpuNode(cores[0]);
+		for (int i = 1; i <= workerCount; ++i) {
+			m_Workers.emplace_back(&ThreadPool::WorkerMain, this, i);
+			if (pin) {
+				const int core = cores[i % cores.size()];
+				PinThread(m_Workers.back(), core);
+				m_ThreadNode[i] = topology.GetCpuNode(core);
+			}
+		}
+	}
+
+	void ThreadPool::Stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_WakeMutex);
+			m_Stopping = true;
+		}
+		m_Wake.notify_all();
+
+		for (std::thread& worker : m_Workers)
+			worker.join();
+		m_Workers.clear();
+	}
+
+	void ThreadPool::Run(int begin, int end, int grain, RangeFunc func, void* context)
+	{
+		const int count = end - begin;
+		if (count <= 0)
+			return;
+
+		grain = std::max(1, grain);
+		if (m_Workers.empty() || t_InPool || count <= grain) {
+			func(context, begin, end);
+			return;
+		}
+
+		std::lock_guard<std::mutex> run_lock(m_RunMutex);
+		m_Func = func;
+		m_Context = context;
+		m_Grain = grain;
+		m_Remaining.store(count, std::memory_order_relaxed);
+
+		// Contiguous slices keep each thread on neighbouring particles until it has to steal
+		const int threads = GetThreadCount();
+		for (int t = 0; t < threads; ++t) {
+			const int slice_begin = begin + static_cast<int>(static_cast<long long>(count) * t / threads);
+			const int slice_end = begin + static_cast<int>(static_cast<long long>(count) * (t + 1) / threads);
+			if (slice_begin < slice_end)
+				Push(t, Range{ slice_begin, slice_end });
+		}
+
+		m_Active.store(GetWorkerCount(), std::memory_order_relaxed);
+		{
+			std::lock_guard<std::mutex> lock(m_WakeMutex);
+			m_Epoch++;
+		}
+		m_Wake.notify_all();
+
+		t_InPool = true;
+		Execute(0);
+		t_InPool = false;
+
+		// The loop's state is reused by the next Run(), so wait until no worker can still read it
+		while (m_Active.load(std::memory_order_acquire) != 0)
+			std::this_thread::yield();
+	}
+
+	void ThreadPool::WorkerMain(int index)
+	{
+		t_InPool = true;
+		unsigned seen = 0;
+		for (;;) {
+			for (int spin = 0; spin < SPIN_COUNT; ++spin) {
+				if (m_Stopping.load(std::memory_order_acquire) || m_Epoch.load(std::memory_order_acquire) != seen)
+					break;
+				std::this_thread::yield();
+			}
+
+			{
+				std::unique_lock<std::mutex> lock(m_WakeMutex);
+				m_Wake.wait(lock, [&]() { return m_Stopping || m_Epoch != seen; });
+				if (m_Stopping)
+					return;
+				seen = m_Epoch.load(std::memory_order_relaxed);
+			}
+
+			Execute(index);
+			m_Active.fetch_sub(1, std::memory_order_release);
+		}
+	}
+
+	void ThreadPool::Execute(int index)
+	{
+		while (m_Remaining.load(std::memory_order_acquire) > 0) {
+			Range range;
+			if (!Pop(index, range) && !Steal(index, range)) {
+				std::this_thread::yield();
+				continue;
+			}
+
+			// Split lazily, leaving the upper halves for this thread or a thief
+			while (range.end - range.begin > m_Grain) {
+				const int middle = range.begin + (range.end - range.begin) / 2;
+				Push(index, Range{ middle, range.end });
+				range.end = middle;
+			}
+
+			m_Func(m_Context, range.begin, range.end);
+			m_Remaining.fetch_sub(range.end - range.begin, std::memory_order_acq_rel);
+		}
+	}
+
+	bool ThreadPool::Pop(int index, Range& range)
+	{
+		Queue& queue = *m_Queues[index];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.ranges.empty())
+			return false;
+
+		range = queue.ranges.back();
+		queue.ranges.pop_back();
+		return true;
+	}
+
+	bool ThreadPool::Steal(int index, Range& range)
+	{
+		// Threads on the same node first, their ranges' memory is local to this one too
+		const int threads = static_cast<int>(m_Queues.size());
+		for (int pass = 0; pass < 2; ++pass) {
+			for (int offset = 1; offset < threads; ++offset) {
+				const int victim_index = (index + offset) % threads;
+				if ((m_ThreadNode[victim_index] == m_ThreadNode[index]) != (pass == 0))
+					continue;
+
+				Queue& victim = *m_Queues[victim_index];
+				std::lock_guard<std::mutex> lock(victim.mutex);
+				if (victim.ranges.empty())
+					continue;
+
+				range = victim.ranges.front();
+				victim.ranges.pop_front();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void ThreadPool::Push(int index, const Range& range)
+	{
+		Queue& queue = *m_Queues[index];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.ranges.push_back(range);
+	}
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Utils {
+	/*
+		Work-stealing pool behind Utils::ParallelFor. Run() hands every thread an equal
+		contiguous slice of [begin, end) and joins in from the calling thread. A thread
+		takes ranges from the back of its own deque and, once that is empty, steals from
+		the front of another's, which holds the largest ranges left. A range is split in
+		half, pushing the upper half, until it is no larger than the grain, so threads
+		that finish early find work without the loop being cut into grain-sized tasks
+		up front.
+
+		Loops of at most one grain, nested loops and pools without workers run inline on
+		the caller. The wasm build has no threads and never starts any workers.
+	*/
+	class ThreadPool
+	{
+	public:
+		using RangeFunc = void (*)(void* context, int begin, int end);
+
+		static ThreadPool& Get();
+
+		ThreadPool();
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		/*
+			Restarts the pool with workerCount threads besides the caller. Pinning
+			binds the caller to the first core and each worker to one of the next,
+			NUMA node by node, so the scheduler does not migrate them between steps
+			and neighbouring threads share a node. The caller's previous affinity is
+			restored once a later Resize() stops pinning.
+		*/
+		void Resize(int workerCount, bool pin);
+
+		inline int GetWorkerCount() const { return static_cast<int>(m_Workers.size()); }
+		// Threads that take part in a Run(), the caller included
+		inline int GetThreadCount() const { return GetWorkerCount() + 1; }
+		inline bool IsPinned() const { return m_Pinned; }
+
+		// NUMA node thread t is pinned to, -1 when the pool is not pinned
+		inline int GetThreadNode(int thread) const { return m_ThreadNode[thread]; }
+
+		// Workers besides the caller by default: one per remaining hardware thread
+		static int DefaultWorkerCount();
+
+		// Calls func(context, b, e) over disjoint ranges covering [begin, end), each at most grain long
+		void Run(int begin, int end, int grain, RangeFunc func, void* context);
+
+		template <typename Func>
+		void Run(int begin, int end, int grain, Func& func)
+		{
+			Run(begin, end, grain,
+				[](void* context, int b, int e) { (*static_cast<Func*>(context))(b, e); },
+				&func);
+		}
+
+	private:
+		struct Range
+		{
+			int begin;
+			int end;
+		};
+
+		struct Queue
+		{
+			std::mutex mutex;
+			std::deque<Range> ranges;
+		};
+
+		void WorkerMain(int index);
+		void Execute(int index);
+		bool Pop(int index, Range& range);
+		bool Steal(int index, Range& range);
+		void Push(int index, const Range& range);
+		void Stop();
+
+		std::vector<std::thread> m_Workers;
+		// One per thread, the caller's is m_Queues[0]
+		std::vector<std::unique_ptr<Queue>> m_Queues;
+		std::vector<int> m_ThreadNode;
+		bool m_Pinned = false;
+
+		// Serialises Run() between callers
+		std::mutex m_RunMutex;
+
+		// The current loop
+		RangeFunc m_Func = nullptr;
+		void* m_Context = nullptr;
+		int m_Grain = 1;
+		std::atomic<int> m_Remaining{ 0 };	// Items not yet processed
+		std::atomic<int> m_Active{ 0 };		// Workers still inside Execute()
+
+		std::mutex m_WakeMutex;
+		std::condition_variable m_Wake;
+		// Written under m_WakeMutex, read without it while a worker spins
+		std::atomic<unsigned> m_Epoch{ 0 };
+		std::atomic<bool> m_Stopping{ false };
+	};
+}
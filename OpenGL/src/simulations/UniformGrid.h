@@ -0,0 +1,90 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+namespace simulation {
+	// Cell of the uniform grid with the given origin and cell size holding position
+	template <int Dim, typename T>
+	inline glm::vec<Dim, int> GetCellCoord(const glm::vec<Dim, T>& position, float origin, float cell_size)
+	{
+		glm::vec<Dim, int> coord;
+		for (int axis = 0; axis < Dim; ++axis)
+			coord[axis] = static_cast<int>(std::floor((position[axis] - origin) / cell_size));
+		return coord;
+	}
+
+	/*
+		Dense grid of width^Dim cells over a bounded domain, keyed in row-major order
+		with x varying fastest. Binned with CellBinner, the cells of one row are adjacent
+		in SortedIndices(), so a stencil of (2 * range + 1)^Dim cells is walked as
+		(2 * range + 1)^(Dim - 1) contiguous rows: 3 in 2D and 9 rows of the 27 cell
+		stencil in 3D.
+	*/
+	template <int Dim>
+	struct DenseGridLayout
+	{
+		using Coord = glm::vec<Dim, int>;
+
+		int width = 0;	// Cells per axis
+
+		inline int CellCount() const
+		{
+			int count = 1;
+			for (int axis = 0; axis < Dim; ++axis)
+				count *= width;
+			return count;
+		}
+
+		// Key of the cell at coord, clamped into the grid
+		inline int Key(const Coord& coord) const
+		{
+			int key = 0;
+			for (int axis = Dim - 1; axis >= 0; --axis)
+				key = key * width + std::clamp(coord[axis], 0, width - 1);
+			return key;
+		}
+
+		inline Coord CellCoord(int key) const
+		{
+			Coord coord;
+			for (int axis = 0; axis < Dim; ++axis) {
+				coord[axis] = key % width;
+				key /= width;
+			}
+			return coord;
+		}
+
+		/*
+			Calls func(first_cell, last_cell) for every row of cells within `range` of
+			coord, clipped to the grid. Both keys are inclusive.
+		*/
+		template <typename Func>
+		inline void ForEachRow(const Coord& coord, int range, Func&& func) const
+		{
+			Coord lo, hi;
+			for (int axis = 0; axis < Dim; ++axis) {
+				lo[axis] = std::max(coord[axis] - range, 0);
+				hi[axis] = std::min(coord[axis] + range, width - 1);
+			}
+			if (lo.x > hi.x)
+				return;
+
+			if constexpr (Dim == 2) {
+				for (int y = lo.y; y <= hi.y; ++y) {
+					const int row = y * width;
+					func(row + lo.x, row + hi.x);
+				}
+			} else {
+				for (int z = lo.z; z <= hi.z; ++z) {
+					for (int y = lo.y; y <= hi.y; ++y) {
+						const int row = (z * width + y) * width;
+						func(row + lo.x, row + hi.x);
+					}
+				}
+			}
+		}
+	};
+}
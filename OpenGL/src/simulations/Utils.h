@@ -0,0 +1,243 @@
+#pragma once
+
+#include "ParallelBackend.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+#ifdef SIM_WITH_TBB
+	#include <tbb/parallel_sort.h>
+#endif
+
+namespace Utils {
+	// Indices per task when a loop does not say otherwise
+	static constexpr int DEFAULT_GRAIN = 64;
+
+	/*
+		Picks the grain of one loop by timing it. Each power of two from MIN_GRAIN to
+		MAX_GRAIN is tried for SAMPLES calls and the one with the fastest call is kept
+		until RETUNE_CALLS calls later, when the search starts again in case the particle
+		or thread count has changed. The largest candidates exceed the particle counts
+		the solvers run, so running the loop inline on the caller is one of the options.
+	*/
+	class GrainTuner
+	{
+	public:
+		static constexpr int MIN_GRAIN = 16;
+		static constexpr int MAX_GRAIN = 4096;
+		static constexpr int SAMPLES = 3;
+		static constexpr int RETUNE_CALLS = 1000;
+
+		GrainTuner() { Restart(); }
+
+		// Grain for the next call
+		inline int Next() const { return m_Exploring ? MIN_GRAIN << m_Candidate : m_Best; }
+		inline int GetBest() const { return m_Best; }
+		inline bool IsExploring() const { return m_Exploring; }
+
+		// Reports how long the call made with Next() took
+		void Record(double seconds)
+		{
+			if (!m_Exploring) {
+				if (++m_Calls >= RETUNE_CALLS)
+					Restart();
+				return;
+			}
+
+			m_Time[m_Candidate] = std::min(m_Time[m_Candidate], seconds);
+			if (++m_Samples < SAMPLES)
+				return;
+
+			m_Samples = 0;
+			if (++m_Candidate < CANDIDATE_COUNT)
+				return;
+
+			const int best = static_cast<int>(std::min_element(m_Time, m_Time + CANDIDATE_COUNT) - m_Time);
+			m_Best = MIN_GRAIN << best;
+			m_Exploring = false;
+			m_Calls = 0;
+		}
+
+		void Restart()
+		{
+			std::fill(m_Time, m_Time + CANDIDATE_COUNT, std::numeric_limits<double>::max());
+			m_Candidate = 0;
+			m_Samples = 0;
+			m_Exploring = true;
+		}
+
+	private:
+		static constexpr int CANDIDATE_COUNT = 9;	// MIN_GRAIN << 8 == MAX_GRAIN
+
+		double m_Time[CANDIDATE_COUNT];
+		int m_Candidate = 0;
+		int m_Samples = 0;
+		int m_Calls = 0;
+		int m_Best = DEFAULT_GRAIN;
+		bool m_Exploring = true;
+	};
+
+	// Grain of a parallel loop: a fixed size, or whatever a GrainTuner picks next
+	struct Grain
+	{
+		Grain(int size) : size(size) {}
+		Grain(GrainTuner& tuner) : size(tuner.Next()), tuner(&tuner) {}
+
+		int size;
+		GrainTuner* tuner = nullptr;
+	};
+
+	// Calls func(b, e) over disjoint ranges covering [begin, end) on the parallel backend
+	template <typename Func>
+	void ParallelForRange(int begin, int end, Grain grain, Func func)
+	{
+		if (!grain.tuner) {
+			RunParallel(begin, end, grain.size, func);
+			return;
+		}
+
+		// Asked again here, a Grain can be reused for several loops
+		const auto start = std::chrono::steady_clock::now();
+		RunParallel(begin, end, grain.tuner->Next(), func);
+		grain.tuner->Record(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	// Calls func(i) for every i in [begin, end) on the parallel backend
+	template <typename Func>
+	void ParallelFor(int begin, int end, Grain grain, Func func)
+	{
+		ParallelForRange(begin, end, grain,
+			[&](int b, int e) {
+				for (int i = b; i < e; ++i)
+					func(i);
+			}
+		);
+	}
+
+	template <typename Iterator, typename T>
+	void ParallelFill(Iterator begin, Iterator end, const T& val)
+	{
+		ParallelForRange(0, static_cast<int>(end - begin), 4096,
+			[&](int b, int e) {
+				std::fill(begin + b, begin + e, val);
+			}
+		);
+	}
+
+	/*
+		Reduces [begin, end) in chunks of chunkSize: map(b, e) gives each chunk's value and
+		the values are folded with reduce in chunk order. The chunks do not depend on the
+		thread count or on which thread ran them, so neither does the result.
+	*/
+	template <typename T, typename Map, typename Reduce>
+	T ParallelReduce(int begin, int end, int chunkSize, T identity, Map map, Reduce reduce)
+	{
+		const int count = end - begin;
+		if (count <= 0)
+			return identity;
+
+		chunkSize = std::max(1, chunkSize);
+		const int chunk_count = (count + chunkSize - 1) / chunkSize;
+		std::vector<T> partial(chunk_count);
+		ParallelFor(0, chunk_count, 1,
+			[&](int chunk) {
+				const int b = begin + chunk * chunkSize;
+				partial[chunk] = map(b, std::min(end, b + chunkSize));
+			}
+		);
+
+		T result = identity;
+		for (int chunk = 0; chunk < chunk_count; ++chunk)
+			result = reduce(result, partial[chunk]);
+		return result;
+	}
+
+	/*
+		Exclusive prefix sum of [begin, end) into out, in chunks of chunkSize: the chunk
+		totals, a serial scan over them, then every chunk scanned from its offset.
+	*/
+	template <typename InputIterator, typename OutputIterator, typename T>
+	void ParallelScan(InputIterator begin, InputIterator end, OutputIterator out, T init, int chunkSize = 4096)
+	{
+		const int count = static_cast<int>(end - begin);
+		if (count <= 0)
+			return;
+
+		chunkSize = std::max(1, chunkSize);
+		const int chunk_count = (count + chunkSize - 1) / chunkSize;
+		std::vector<T> offsets(chunk_count);
+		ParallelFor(0, chunk_count, 1,
+			[&](int chunk) {
+				const int b = chunk * chunkSize;
+				const int e = std::min(count, b + chunkSize);
+				T total = begin[b];
+				for (int k = b + 1; k < e; ++k)
+					total = total + begin[k];
+				offsets[chunk] = total;
+			}
+		);
+
+		T running = init;
+		for (int chunk = 0; chunk < chunk_count; ++chunk) {
+			const T total = offsets[chunk];
+			offsets[chunk] = running;
+			running = running + total;
+		}
+
+		ParallelFor(0, chunk_count, 1,
+			[&](int chunk) {
+				const int b = chunk * chunkSize;
+				const int e = std::min(count, b + chunkSize);
+				T sum = offsets[chunk];
+				for (int k = b; k < e; ++k) {
+					const T value = begin[k];
+					out[k] = sum;
+					sum = sum + value;
+				}
+			}
+		);
+	}
+
+	/*
+		Sorts one run per thread in parallel, then merges neighbouring runs pairwise until
+		one is left. TBB brings its own parallel sort. The result is the same on every
+		backend as long as comp is a strict total order on the values.
+	*/
+	template <typename Iterator, typename Compare>
+	void ParallelSort(Iterator begin, Iterator end, Compare comp)
+	{
+#ifdef SIM_WITH_TBB
+		if (GetParallelBackend() == ParallelBackend::TBB) {
+			tbb::parallel_sort(begin, end, comp);
+			return;
+		}
+#endif
+		const int count = static_cast<int>(end - begin);
+		const int runs = std::min(GetParallelThreadCount(), count / 1024);
+		if (runs <= 1) {
+			std::sort(begin, end, comp);
+			return;
+		}
+
+		std::vector<int> bounds(runs + 1);
+		for (int r = 0; r <= runs; ++r)
+			bounds[r] = static_cast<int>(static_cast<long long>(count) * r / runs);
+
+		ParallelFor(0, runs, 1, [&](int r) { std::sort(begin + bounds[r], begin + bounds[r + 1], comp); });
+
+		for (int width = 1; width < runs; width *= 2) {
+			ParallelFor(0, (runs + 2 * width - 1) / (2 * width), 1,
+				[&](int pair) {
+					const int first = 2 * width * pair;
+					const int middle = std::min(runs, first + width);
+					const int last = std::min(runs, first + 2 * width);
+					if (middle < last)
+						std::inplace_merge(begin + bounds[first], begin + bounds[middle], begin + bounds[last], comp);
+				}
+			);
+		}
+	}
+}